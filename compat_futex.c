@@ -27,6 +27,8 @@
 #include <errno.h>
 #include <poll.h>
 #include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include <urcu/arch.h>
 #include <urcu/futex.h>
@@ -36,8 +38,9 @@ static pthread_cond_t compat_futex_cond = PTHREAD_COND_INITIALIZER;
 
 /*
  * _NOT SIGNAL-SAFE_. pthread_cond is not signal-safe anyway. Though.
- * For now, timeout, uaddr2 and val3 are unused.
- * Waiter will relinquish the CPU until woken up.
+ * For now, uaddr2 and val3 are unused. timeout is relative, as for
+ * FUTEX_WAIT.
+ * Waiter will relinquish the CPU until woken up or timed out.
  */
 
 int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
@@ -49,7 +52,6 @@ int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
 	 * Check if NULL. Don't let users expect that they are taken into
 	 * account. 
 	 */
-	assert(!timeout);
 	assert(!uaddr2);
 	assert(!val3);
 
@@ -64,7 +66,24 @@ int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
 	case FUTEX_WAIT:
 		if (*uaddr != val)
 			goto end;
-		pthread_cond_wait(&compat_futex_cond, &compat_futex_lock);
+		if (timeout) {
+			struct timeval now;
+			struct timespec abstime;
+
+			/* pthread_cond_timedwait() uses CLOCK_REALTIME. */
+			gettimeofday(&now, NULL);
+			abstime.tv_sec = now.tv_sec + timeout->tv_sec;
+			abstime.tv_nsec = now.tv_usec * 1000 + timeout->tv_nsec;
+			if (abstime.tv_nsec >= 1000000000) {
+				abstime.tv_sec++;
+				abstime.tv_nsec -= 1000000000;
+			}
+			if (pthread_cond_timedwait(&compat_futex_cond,
+					&compat_futex_lock, &abstime) == ETIMEDOUT)
+				gret = -ETIMEDOUT;
+		} else {
+			pthread_cond_wait(&compat_futex_cond, &compat_futex_lock);
+		}
 		break;
 	case FUTEX_WAKE:
 		pthread_cond_broadcast(&compat_futex_cond);
@@ -80,18 +99,20 @@ end:
 
 /*
  * _ASYNC SIGNAL-SAFE_.
- * For now, timeout, uaddr2 and val3 are unused.
+ * For now, uaddr2 and val3 are unused. timeout is relative, as for
+ * FUTEX_WAIT, and rounded up to the 10ms polling period.
  * Waiter will busy-loop trying to read the condition.
  */
 
 int compat_futex_async(int32_t *uaddr, int op, int32_t val,
 	const struct timespec *timeout, int32_t *uaddr2, int32_t val3)
 {
+	long polls = -1;	/* Remaining polls, -1 if unbounded */
+
 	/*
 	 * Check if NULL. Don't let users expect that they are taken into
 	 * account. 
 	 */
-	assert(!timeout);
 	assert(!uaddr2);
 	assert(!val3);
 
@@ -102,8 +123,14 @@ int compat_futex_async(int32_t *uaddr, int op, int32_t val,
 
 	switch (op) {
 	case FUTEX_WAIT:
-		while (*uaddr == val)
+		if (timeout)
+			polls = timeout->tv_sec * 100
+				+ (timeout->tv_nsec + 9999999) / 10000000;
+		while (*uaddr == val) {
+			if (!polls--)
+				return -ETIMEDOUT;
 			poll(NULL, 0, 10);
+		}
 		break;
 	case FUTEX_WAKE:
 		break;
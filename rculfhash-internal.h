@@ -55,6 +55,7 @@ do {								\
 #endif
 
 struct ht_items_count;
+struct ht_fp_block;
 
 /*
  * cds_lfht: Top-level data structure representing a lock-free hash
@@ -82,6 +83,7 @@ struct cds_lfht {
 	 */
 	pthread_mutex_t resize_mutex;	/* resize mutex: add/del mutex */
 	pthread_attr_t *resize_attr;	/* Resize threads attributes */
+	struct partition_resize_pool *resize_pool;	/* Resize threads */
 	unsigned int in_progress_resize, in_progress_destroy;
 	unsigned long resize_target;
 	int resize_initiated;
@@ -97,6 +99,9 @@ struct cds_lfht {
 	/*
 	 * Variables needed for the lookup, add and remove fast-paths.
 	 */
+	struct ht_fp_block **fp_index;	/* fingerprint blocks, shared (RCU) */
+	unsigned long fp_index_mask;
+	unsigned long fp_index_order;
 	unsigned long size;	/* always a power of 2, shared (RCU) */
 	/*
 	 * bucket_at pointer is kept here to skip the extra level of
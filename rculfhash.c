@@ -262,8 +262,11 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 #include "config.h"
 #include <urcu.h>
@@ -300,6 +303,11 @@
 #define MIN_PARTITION_PER_THREAD_ORDER	12
 #define MIN_PARTITION_PER_THREAD	(1UL << MIN_PARTITION_PER_THREAD_ORDER)
 
+/*
+ * Resize worker threads exit after this many seconds without work.
+ */
+#define PARTITION_RESIZE_IDLE_TIMEOUT	1
+
 /*
  * The removed flag needs to be updated atomically with the pointer.
  * It indicates that no node must attach to the node scheduled for
@@ -344,18 +352,58 @@ struct rcu_resize_work {
 };
 
 /*
- * partition_resize_work: Contains arguments passed to worker threads
- * executing the hash table resize on partitions of the hash table
- * assigned to each processor's worker thread.
+ * partition_resize_pool: Worker threads executing the hash table
+ * resize on partitions of the hash table. Partitioned resizes start
+ * workers until there is one per partition, up to one per processor.
+ * Workers stay around for the next resize levels, and exit once idle
+ * for PARTITION_RESIZE_IDLE_TIMEOUT seconds. They are only registered
+ * as RCU readers while working on a partition, so that idle workers
+ * leave no registry entry behind in the child of a fork(). They are
+ * detached: hash table destroy waits for all of them to have exited.
+ * Resizes are serialized by the resize mutex, so the pool executes one
+ * resize level at a time: workers take the partitions of the current
+ * level by index, the resize thread waits for all of them to be done.
  */
-struct partition_resize_work {
-	pthread_t thread_id;
+struct partition_resize_pool {
 	struct cds_lfht *ht;
-	unsigned long i, start, len;
+	pid_t pid;			/* Process owning the workers */
+	pthread_mutex_t lock;		/* Protects the fields below */
+	pthread_cond_t work_cond, done_cond;
+	unsigned long nr_workers;	/* Workers taking partitions */
+	int stop;
+	unsigned long i, partition_len;
+	unsigned long next_partition, nr_partitions, nr_done;
 	void (*fct)(struct cds_lfht *ht, unsigned long i,
 		    unsigned long start, unsigned long len);
 };
 
+/*
+ * ht_fp_block: Fingerprint index block, only used if the
+ * CDS_LFHT_FINGERPRINT flag is set at hash table creation.
+ *
+ * The index has one block per initial bucket, selected by the low bits
+ * of the hash. A block holds one tag per node of its hashes: the byte
+ * of the hash just above the bits selecting the block. Once the block
+ * is full, further nodes are counted as overflow. A lookup whose tag is
+ * absent from a block without overflow is done without walking the
+ * chain. Tags fit in one cache line, and are compared a word at a time.
+ * Slots past nr_tags repeat the first tag, so that all words can be
+ * compared.
+ *
+ * Blocks are never modified once published: updates replace them with
+ * a copy by cmpxchg, and free the old one after a grace period. Nodes
+ * get their tag before being added, and lose it once removed.
+ */
+#define FP_BLOCK_WORDS		7
+#define FP_BLOCK_TAGS		(FP_BLOCK_WORDS * sizeof(uint64_t))
+
+struct ht_fp_block {
+	uint32_t nr_tags;
+	uint32_t overflow;	/* nodes without tag */
+	uint64_t tags[FP_BLOCK_WORDS];
+	struct rcu_head head;
+} __attribute__((aligned(64)));
+
 /*
  * Algorithm to reverse bits in a word by lookup table, extended to
  * 64-bit words.
@@ -723,6 +771,132 @@ void check_resize(struct cds_lfht *ht, unsigned long size, uint32_t chain_len)
 			cds_lfht_get_count_order_u32(chain_len - (CHAIN_LEN_TARGET - 1)));
 }
 
+/*
+ * The high bits of a 32-bit hash stored in an unsigned long are zero:
+ * take the tag right above the block index instead.
+ */
+static
+uint8_t fp_tag(struct cds_lfht *ht, unsigned long hash)
+{
+	return (hash >> ht->fp_index_order) & 0xff;
+}
+
+static
+struct ht_fp_block **fp_index_slot(struct cds_lfht *ht, unsigned long hash)
+{
+	return &ht->fp_index[hash & ht->fp_index_mask];
+}
+
+/*
+ * Returns 0 if no node with this hash is in the table, 1 if there may
+ * be one.
+ */
+static inline
+int fp_index_may_contain(struct cds_lfht *ht, unsigned long hash)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	struct ht_fp_block *block;
+	uint64_t x, tags, found = 0;
+	int i;
+
+	block = rcu_dereference(*fp_index_slot(ht, hash));
+	if (!block)
+		return 0;
+	if (block->overflow)
+		return 1;
+	tags = ones * fp_tag(ht, hash);
+	/* Find a zero byte in tags ^ tag. */
+	for (i = 0; i < FP_BLOCK_WORDS; i++) {
+		x = block->tags[i] ^ tags;
+		found |= (x - ones) & ~x & (ones << 7);
+	}
+	return found != 0;
+}
+
+static
+void fp_block_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct ht_fp_block, head));
+}
+
+/*
+ * Fill new with old, plus or minus one node of tag. Returns 0 if new
+ * is left empty.
+ */
+static
+int fp_block_copy(struct ht_fp_block *new, struct ht_fp_block *old,
+		uint8_t tag, int add)
+{
+	uint8_t *tags = (uint8_t *) new->tags;
+	unsigned int i;
+
+	if (old)
+		memcpy(new, old, offsetof(struct ht_fp_block, head));
+	else
+		new->nr_tags = new->overflow = 0;
+	if (add) {
+		if (new->nr_tags < FP_BLOCK_TAGS)
+			tags[new->nr_tags++] = tag;
+		else
+			new->overflow++;
+	} else {
+		for (i = 0; i < new->nr_tags; i++)
+			if (tags[i] == tag)
+				break;
+		if (i < new->nr_tags) {
+			tags[i] = tags[--new->nr_tags];
+		} else {
+			/* The node is one of the overflow. */
+			assert(new->overflow);
+			new->overflow--;
+		}
+	}
+	for (i = new->nr_tags; i < FP_BLOCK_TAGS; i++)
+		tags[i] = tags[0];
+	return new->nr_tags || new->overflow;
+}
+
+/*
+ * Add or remove the tag of a node. Called within a read-side critical
+ * section, which keeps the old block from being reused for the cmpxchg.
+ */
+static
+void fp_index_update(struct cds_lfht *ht, unsigned long hash, int add)
+{
+	struct ht_fp_block **slot = fp_index_slot(ht, hash);
+	struct ht_fp_block *old, *new, *copy;
+	int ret;
+
+	ret = posix_memalign((void **) &copy, sizeof(*copy), sizeof(*copy));
+	assert(!ret);
+	for (;;) {
+		old = rcu_dereference(*slot);
+		new = fp_block_copy(copy, old, fp_tag(ht, hash), add) ?
+			copy : NULL;
+		/* cmpxchg publishes the copy. */
+		if (uatomic_cmpxchg(slot, old, new) == old)
+			break;
+	}
+	if (!new)
+		free(copy);
+	if (old)
+		ht->flavor->update_call_rcu(&old->head, fp_block_free);
+}
+
+static
+void fp_index_add(struct cds_lfht *ht, unsigned long hash)
+{
+	if (ht->fp_index)
+		fp_index_update(ht, hash, 1);
+}
+
+static
+void fp_index_del(struct cds_lfht *ht, unsigned long hash)
+{
+	if (ht->fp_index)
+		fp_index_update(ht, hash, 0);
+}
+
 static
 struct cds_lfht_node *clear_flag(struct cds_lfht_node *node)
 {
@@ -936,11 +1110,92 @@ int _cds_lfht_replace(struct cds_lfht *ht, unsigned long size,
 	return 0;
 }
 
+/*
+ * The lookup and add paths are always inlined, so that the match
+ * function of the specialized key types below is inlined as well.
+ */
+static inline __attribute__((always_inline))
+void _cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
+		cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_iter *iter)
+{
+	struct cds_lfht_node *node, *next, *bucket;
+	unsigned long reverse_hash, size;
+
+	if (ht->fp_index && !fp_index_may_contain(ht, hash)) {
+		iter->node = iter->next = NULL;
+		return;
+	}
+	reverse_hash = bit_reverse_ulong(hash);
+
+	size = rcu_dereference(ht->size);
+	bucket = lookup_bucket(ht, size, hash);
+	/* We can always skip the bucket node initially */
+	node = rcu_dereference(bucket->next);
+	node = clear_flag(node);
+	for (;;) {
+		if (caa_unlikely(is_end(node))) {
+			node = next = NULL;
+			break;
+		}
+		if (caa_unlikely(node->reverse_hash > reverse_hash)) {
+			node = next = NULL;
+			break;
+		}
+		next = rcu_dereference(node->next);
+		assert(node == clear_flag(node));
+		if (caa_likely(!is_removed(next))
+		    && !is_bucket(next)
+		    && node->reverse_hash == reverse_hash
+		    && caa_likely(match(node, key))) {
+				break;
+		}
+		node = clear_flag(next);
+	}
+	assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
+	iter->node = node;
+	iter->next = next;
+}
+
+static inline __attribute__((always_inline))
+void _cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
+		const void *key, struct cds_lfht_iter *iter)
+{
+	struct cds_lfht_node *node, *next;
+	unsigned long reverse_hash;
+
+	node = iter->node;
+	reverse_hash = node->reverse_hash;
+	next = iter->next;
+	node = clear_flag(next);
+
+	for (;;) {
+		if (caa_unlikely(is_end(node))) {
+			node = next = NULL;
+			break;
+		}
+		if (caa_unlikely(node->reverse_hash > reverse_hash)) {
+			node = next = NULL;
+			break;
+		}
+		next = rcu_dereference(node->next);
+		if (caa_likely(!is_removed(next))
+		    && !is_bucket(next)
+		    && caa_likely(match(node, key))) {
+				break;
+		}
+		node = clear_flag(next);
+	}
+	assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
+	iter->node = node;
+	iter->next = next;
+}
+
 /*
  * A non-NULL unique_ret pointer uses the "add unique" (or uniquify) add
  * mode. A NULL unique_ret allows creation of duplicate keys.
  */
-static
+static inline __attribute__((always_inline))
 void _cds_lfht_add(struct cds_lfht *ht,
 		unsigned long hash,
 		cds_lfht_match_fct match,
@@ -997,7 +1252,7 @@ void _cds_lfht_add(struct cds_lfht *ht,
 				 * (including traversing the table node by
 				 * node by forward iterations)
 				 */
-				cds_lfht_next_duplicate(ht, match, key, &d_iter);
+				_cds_lfht_next_duplicate(ht, match, key, &d_iter);
 				if (!d_iter.node)
 					goto insert;
 
@@ -1119,29 +1374,135 @@ int _cds_lfht_del(struct cds_lfht *ht, unsigned long size,
 static
 void *partition_resize_thread(void *arg)
 {
-	struct partition_resize_work *work = arg;
+	struct partition_resize_pool *pool = arg;
+	struct cds_lfht *ht = pool->ht;
+	const struct rcu_flavor_struct *flavor = ht->flavor;
+	unsigned long partition;
+	struct timeval now;
+	struct timespec abstime;
+	int ret;
 
-	work->ht->flavor->register_thread();
-	work->fct(work->ht, work->i, work->start, work->len);
-	work->ht->flavor->unregister_thread();
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		/* pthread_cond_timedwait() uses CLOCK_REALTIME. */
+		gettimeofday(&now, NULL);
+		abstime.tv_sec = now.tv_sec + PARTITION_RESIZE_IDLE_TIMEOUT;
+		abstime.tv_nsec = now.tv_usec * 1000;
+		ret = 0;
+		while (!pool->stop && ret != ETIMEDOUT
+		       && pool->next_partition == pool->nr_partitions)
+			ret = pthread_cond_timedwait(&pool->work_cond,
+					&pool->lock, &abstime);
+		if (pool->stop || pool->next_partition == pool->nr_partitions)
+			break;
+		partition = pool->next_partition++;
+		pthread_mutex_unlock(&pool->lock);
+		flavor->register_thread();
+		pool->fct(ht, pool->i, partition * pool->partition_len,
+			  pool->partition_len);
+		flavor->unregister_thread();
+		pthread_mutex_lock(&pool->lock);
+		if (++pool->nr_done == pool->nr_partitions)
+			pthread_cond_broadcast(&pool->done_cond);
+	}
+	/* Stopped or idle: no more partitions for us. */
+	if (!--pool->nr_workers)
+		pthread_cond_broadcast(&pool->done_cond);
+	pthread_mutex_unlock(&pool->lock);
 	return NULL;
 }
 
+static
+void partition_resize_pool_free(struct partition_resize_pool *pool)
+{
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+static
+void partition_resize_pool_destroy(struct cds_lfht *ht)
+{
+	struct partition_resize_pool *pool = ht->resize_pool;
+
+	if (!pool)
+		return;
+	ht->resize_pool = NULL;
+	/* Leak the pool of the parent, see partition_resize_pool_get(). */
+	if (pool->pid != getpid())
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	while (pool->nr_workers)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	partition_resize_pool_free(pool);
+}
+
+/*
+ * Called with the resize mutex held.
+ */
+static
+struct partition_resize_pool *partition_resize_pool_get(struct cds_lfht *ht)
+{
+	struct partition_resize_pool *pool = ht->resize_pool;
+
+	/*
+	 * A pool of another pid comes from our parent: its workers did not
+	 * survive fork(), and one of them may have held the pool lock.
+	 * Leak it without touching its lock and conditions, and start new
+	 * workers.
+	 */
+	if (pool && pool->pid == getpid())
+		return pool;
+	pool = calloc(1, sizeof(*pool));
+	assert(pool);
+	pool->ht = ht;
+	pool->pid = getpid();
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	ht->resize_pool = pool;
+	return pool;
+}
+
+/*
+ * Start workers until there is one per partition. Called with the pool
+ * lock held.
+ */
+static
+void partition_resize_pool_grow(struct partition_resize_pool *pool,
+		unsigned long nr_partitions)
+{
+	pthread_t worker;
+	int ret;
+
+	while (pool->nr_workers < nr_partitions) {
+		ret = pthread_create(&worker, pool->ht->resize_attr,
+			partition_resize_thread, pool);
+		assert(!ret);
+		ret = pthread_detach(worker);
+		assert(!ret);
+		pool->nr_workers++;
+	}
+}
+
 static
 void partition_resize_helper(struct cds_lfht *ht, unsigned long i,
 		unsigned long len,
 		void (*fct)(struct cds_lfht *ht, unsigned long i,
 			unsigned long start, unsigned long len))
 {
-	unsigned long partition_len;
-	struct partition_resize_work *work;
-	int thread, ret;
+	struct partition_resize_pool *pool;
 	unsigned long nr_threads;
 
 	/*
 	 * Note: nr_cpus_mask + 1 is always power of 2.
-	 * We spawn just the number of threads we need to satisfy the minimum
-	 * partition size, up to the number of CPUs in the system.
+	 * We split the work in just the number of partitions we need to
+	 * satisfy the minimum partition size, up to the number of CPUs in
+	 * the system.
 	 */
 	if (nr_cpus_mask > 0) {
 		nr_threads = min(nr_cpus_mask + 1,
@@ -1149,24 +1510,19 @@ void partition_resize_helper(struct cds_lfht *ht, unsigned long i,
 	} else {
 		nr_threads = 1;
 	}
-	partition_len = len >> cds_lfht_get_count_order_ulong(nr_threads);
-	work = calloc(nr_threads, sizeof(*work));
-	assert(work);
-	for (thread = 0; thread < nr_threads; thread++) {
-		work[thread].ht = ht;
-		work[thread].i = i;
-		work[thread].len = partition_len;
-		work[thread].start = thread * partition_len;
-		work[thread].fct = fct;
-		ret = pthread_create(&(work[thread].thread_id), ht->resize_attr,
-			partition_resize_thread, &work[thread]);
-		assert(!ret);
-	}
-	for (thread = 0; thread < nr_threads; thread++) {
-		ret = pthread_join(work[thread].thread_id, NULL);
-		assert(!ret);
-	}
-	free(work);
+	pool = partition_resize_pool_get(ht);
+	pthread_mutex_lock(&pool->lock);
+	pool->i = i;
+	pool->partition_len = len >> cds_lfht_get_count_order_ulong(nr_threads);
+	pool->fct = fct;
+	pool->next_partition = 0;
+	pool->nr_done = 0;
+	pool->nr_partitions = nr_threads;
+	partition_resize_pool_grow(pool, nr_threads);
+	pthread_cond_broadcast(&pool->work_cond);
+	while (pool->nr_done < pool->nr_partitions)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
 }
 
 /*
@@ -1481,6 +1837,12 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
 	ht->flags = flags;
 	ht->flavor = flavor;
 	ht->resize_attr = attr;
+	if (flags & CDS_LFHT_FINGERPRINT) {
+		ht->fp_index = calloc(init_size, sizeof(*ht->fp_index));
+		assert(ht->fp_index);
+		ht->fp_index_mask = init_size - 1;
+		ht->fp_index_order = cds_lfht_get_count_order_ulong(init_size);
+	}
 	alloc_split_items_count(ht);
 	/* this mutex should not nest in read-side C.S. */
 	pthread_mutex_init(&ht->resize_mutex, NULL);
@@ -1495,71 +1857,91 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		cds_lfht_match_fct match, const void *key,
 		struct cds_lfht_iter *iter)
 {
-	struct cds_lfht_node *node, *next, *bucket;
-	unsigned long reverse_hash, size;
+	_cds_lfht_lookup(ht, hash, match, key, iter);
+}
 
-	reverse_hash = bit_reverse_ulong(hash);
+/*
+ * Lookups are walked in groups of LOOKUP_BATCH_SIZE: each step of the
+ * walk prefetches the node the next step reads, and the other lookups of
+ * the group are stepped meanwhile, so their cache misses overlap.
+ */
+#define LOOKUP_BATCH_SIZE	16
 
-	size = rcu_dereference(ht->size);
-	bucket = lookup_bucket(ht, size, hash);
-	/* We can always skip the bucket node initially */
-	node = rcu_dereference(bucket->next);
-	node = clear_flag(node);
-	for (;;) {
-		if (caa_unlikely(is_end(node))) {
-			node = next = NULL;
-			break;
-		}
-		if (caa_unlikely(node->reverse_hash > reverse_hash)) {
-			node = next = NULL;
-			break;
+static
+void lookup_batch_group(struct cds_lfht *ht, unsigned long size,
+		unsigned long n, const unsigned long *hashes,
+		cds_lfht_match_fct match, const void * const *keys,
+		struct cds_lfht_iter *iters)
+{
+	struct cds_lfht_node *node[LOOKUP_BATCH_SIZE], *next;
+	unsigned long reverse_hash[LOOKUP_BATCH_SIZE];
+	unsigned int active[LOOKUP_BATCH_SIZE];
+	unsigned long i, j, nr_active = 0;
+
+	for (i = 0; i < n; i++) {
+		if (ht->fp_index && !fp_index_may_contain(ht, hashes[i])) {
+			iters[i].node = iters[i].next = NULL;
+			continue;
 		}
-		next = rcu_dereference(node->next);
-		assert(node == clear_flag(node));
-		if (caa_likely(!is_removed(next))
-		    && !is_bucket(next)
-		    && node->reverse_hash == reverse_hash
-		    && caa_likely(match(node, key))) {
-				break;
+		reverse_hash[i] = bit_reverse_ulong(hashes[i]);
+		node[i] = lookup_bucket(ht, size, hashes[i]);
+		__builtin_prefetch(node[i]);
+		active[nr_active++] = i;
+	}
+	/* We can always skip the bucket node initially */
+	for (j = 0; j < nr_active; j++) {
+		i = active[j];
+		node[i] = clear_flag(rcu_dereference(node[i]->next));
+		if (!is_end(node[i]))
+			__builtin_prefetch(node[i]);
+	}
+	/* Step each unfinished lookup by one node per round. */
+	while (nr_active) {
+		for (j = 0; j < nr_active;) {
+			i = active[j];
+			if (caa_unlikely(is_end(node[i]))
+			    || caa_unlikely(node[i]->reverse_hash > reverse_hash[i])) {
+				iters[i].node = iters[i].next = NULL;
+				active[j] = active[--nr_active];
+				continue;
+			}
+			next = rcu_dereference(node[i]->next);
+			assert(node[i] == clear_flag(node[i]));
+			if (caa_likely(!is_removed(next))
+			    && !is_bucket(next)
+			    && node[i]->reverse_hash == reverse_hash[i]
+			    && caa_likely(match(node[i], keys[i]))) {
+				assert(!is_bucket(CMM_LOAD_SHARED(node[i]->next)));
+				iters[i].node = node[i];
+				iters[i].next = next;
+				active[j] = active[--nr_active];
+				continue;
+			}
+			node[i] = clear_flag(next);
+			if (!is_end(node[i]))
+				__builtin_prefetch(node[i]);
+			j++;
 		}
-		node = clear_flag(next);
 	}
-	assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
-	iter->node = node;
-	iter->next = next;
 }
 
-void cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
-		const void *key, struct cds_lfht_iter *iter)
+void cds_lfht_lookup_batch(struct cds_lfht *ht, unsigned long n,
+		const unsigned long *hashes, cds_lfht_match_fct match,
+		const void * const *keys, struct cds_lfht_iter *iters)
 {
-	struct cds_lfht_node *node, *next;
-	unsigned long reverse_hash;
+	unsigned long size, i;
 
-	node = iter->node;
-	reverse_hash = node->reverse_hash;
-	next = iter->next;
-	node = clear_flag(next);
+	size = rcu_dereference(ht->size);
+	for (i = 0; i < n; i += LOOKUP_BATCH_SIZE)
+		lookup_batch_group(ht, size,
+			caa_min(n - i, (unsigned long) LOOKUP_BATCH_SIZE),
+			&hashes[i], match, &keys[i], &iters[i]);
+}
 
-	for (;;) {
-		if (caa_unlikely(is_end(node))) {
-			node = next = NULL;
-			break;
-		}
-		if (caa_unlikely(node->reverse_hash > reverse_hash)) {
-			node = next = NULL;
-			break;
-		}
-		next = rcu_dereference(node->next);
-		if (caa_likely(!is_removed(next))
-		    && !is_bucket(next)
-		    && caa_likely(match(node, key))) {
-				break;
-		}
-		node = clear_flag(next);
-	}
-	assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
-	iter->node = node;
-	iter->next = next;
+void cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
+		const void *key, struct cds_lfht_iter *iter)
+{
+	_cds_lfht_next_duplicate(ht, match, key, iter);
 }
 
 void cds_lfht_next(struct cds_lfht *ht, struct cds_lfht_iter *iter)
@@ -1600,12 +1982,14 @@ void cds_lfht_add(struct cds_lfht *ht, unsigned long hash,
 	unsigned long size;
 
 	node->reverse_hash = bit_reverse_ulong(hash);
+	fp_index_add(ht, hash);
 	size = rcu_dereference(ht->size);
 	_cds_lfht_add(ht, hash, NULL, NULL, size, node, NULL, 0);
 	ht_count_add(ht, size, hash);
 }
 
-struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
+static inline __attribute__((always_inline))
+struct cds_lfht_node *_cds_lfht_add_unique(struct cds_lfht *ht,
 				unsigned long hash,
 				cds_lfht_match_fct match,
 				const void *key,
@@ -1614,15 +1998,29 @@ struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
 	unsigned long size;
 	struct cds_lfht_iter iter;
 
+	/*
+	 * Look the key up first, so that adding a duplicate does not
+	 * update the fingerprint index twice. The index only tells
+	 * whether the key may be present: the lookup stays cheap.
+	 */
+	if (ht->fp_index) {
+		_cds_lfht_lookup(ht, hash, match, key, &iter);
+		if (iter.node)
+			return iter.node;
+	}
 	node->reverse_hash = bit_reverse_ulong(hash);
+	fp_index_add(ht, hash);
 	size = rcu_dereference(ht->size);
 	_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0);
 	if (iter.node == node)
 		ht_count_add(ht, size, hash);
+	else
+		fp_index_del(ht, hash);
 	return iter.node;
 }
 
-struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
+static inline __attribute__((always_inline))
+struct cds_lfht_node *_cds_lfht_add_replace(struct cds_lfht *ht,
 				unsigned long hash,
 				cds_lfht_match_fct match,
 				const void *key,
@@ -1632,6 +2030,7 @@ struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
 	struct cds_lfht_iter iter;
 
 	node->reverse_hash = bit_reverse_ulong(hash);
+	fp_index_add(ht, hash);
 	size = rcu_dereference(ht->size);
 	for (;;) {
 		_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0);
@@ -1640,11 +2039,74 @@ struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
 			return NULL;
 		}
 
-		if (!_cds_lfht_replace(ht, size, iter.node, iter.next, node))
+		if (!_cds_lfht_replace(ht, size, iter.node, iter.next, node)) {
+			/* The replaced node takes its tag along. */
+			fp_index_del(ht, hash);
 			return iter.node;
+		}
 	}
 }
 
+struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
+				unsigned long hash,
+				cds_lfht_match_fct match,
+				const void *key,
+				struct cds_lfht_node *node)
+{
+	return _cds_lfht_add_unique(ht, hash, match, key, node);
+}
+
+struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
+				unsigned long hash,
+				cds_lfht_match_fct match,
+				const void *key,
+				struct cds_lfht_node *node)
+{
+	return _cds_lfht_add_replace(ht, hash, match, key, node);
+}
+
+/*
+ * Lookup and add functions specialized for the fixed-size keys of
+ * struct cds_lfht_node_u32, _u64 and _u128: the generic paths are
+ * expanded with a match function comparing keys inline.
+ */
+#define DEFINE_CDS_LFHT_KEY_TYPE(suffix, key_type, key_equal)		\
+static inline								\
+int cds_lfht_match_##suffix(struct cds_lfht_node *node, const void *key) \
+{									\
+	struct cds_lfht_node_##suffix *knode =				\
+		caa_container_of(node, struct cds_lfht_node_##suffix, node); \
+									\
+	return key_equal(knode->key, *(const key_type *) key);		\
+}									\
+									\
+void cds_lfht_lookup_##suffix(struct cds_lfht *ht, unsigned long hash,	\
+		key_type key, struct cds_lfht_iter *iter)		\
+{									\
+	_cds_lfht_lookup(ht, hash, cds_lfht_match_##suffix, &key, iter); \
+}									\
+									\
+struct cds_lfht_node *cds_lfht_add_unique_##suffix(struct cds_lfht *ht, \
+		unsigned long hash, struct cds_lfht_node_##suffix *node) \
+{									\
+	return _cds_lfht_add_unique(ht, hash, cds_lfht_match_##suffix,	\
+			&node->key, &node->node);			\
+}									\
+									\
+struct cds_lfht_node *cds_lfht_add_replace_##suffix(struct cds_lfht *ht, \
+		unsigned long hash, struct cds_lfht_node_##suffix *node) \
+{									\
+	return _cds_lfht_add_replace(ht, hash, cds_lfht_match_##suffix,	\
+			&node->key, &node->node);			\
+}
+
+#define KEY_EQUAL(a, b)		((a) == (b))
+#define KEY_EQUAL_U128(a, b)	((a).lo == (b).lo && (a).hi == (b).hi)
+
+DEFINE_CDS_LFHT_KEY_TYPE(u32, uint32_t, KEY_EQUAL)
+DEFINE_CDS_LFHT_KEY_TYPE(u64, uint64_t, KEY_EQUAL)
+DEFINE_CDS_LFHT_KEY_TYPE(u128, struct cds_lfht_key_u128, KEY_EQUAL_U128)
+
 int cds_lfht_replace(struct cds_lfht *ht,
 		struct cds_lfht_iter *old_iter,
 		unsigned long hash,
@@ -1678,6 +2140,7 @@ int cds_lfht_del(struct cds_lfht *ht, struct cds_lfht_node *node)
 
 		hash = bit_reverse_ulong(node->reverse_hash);
 		ht_count_del(ht, size, hash);
+		fp_index_del(ht, hash);
 	}
 	return ret;
 }
@@ -1738,7 +2201,10 @@ int cds_lfht_destroy(struct cds_lfht *ht, pthread_attr_t **attr)
 	ret = cds_lfht_delete_bucket(ht);
 	if (ret)
 		return ret;
+	partition_resize_pool_destroy(ht);
 	free_split_items_count(ht);
+	/* The table is empty, so are all fingerprint blocks. */
+	free(ht->fp_index);
 	if (attr)
 		*attr = ht->resize_attr;
 	poison_free(ht);
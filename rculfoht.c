@@ -0,0 +1,416 @@
+/*
+ * rculfoht.c
+ *
+ * Userspace RCU library - Lock-Free Open-Addressing RCU Hash Table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Based on the following ideas:
+ * - Open addressing with linear probing over an array of key-value
+ *   slots. A key is added by claiming an empty slot with a cmpxchg on
+ *   its key word, then setting its value with a cmpxchg on its value
+ *   word. A slot keeps its key once claimed: removal only resets the
+ *   value, so that probe sequences never break.
+ * - Resize allocates a new array, linked from the current one through
+ *   its "next" pointer, and moves every slot to it, as in Cliff Click's
+ *   non-blocking hash table:
+ *   1) empty slots are frozen by setting their key to KEY_FROZEN, so
+ *      that no key can be added to them anymore,
+ *   2) used slots are frozen by setting VALUE_FROZEN in their value,
+ *      which keeps the value readable but fails all later updates,
+ *   3) the frozen value is copied to the new array, only if the key
+ *      has no value there yet (VALUE_UNSET): a slow copy can never
+ *      overwrite an update done after the move,
+ *   4) the slot is marked as moved (VALUE_FROZEN | VALUE_NONE).
+ *   Each step is idempotent, so any thread can perform it. An update
+ *   finding a frozen slot completes its move, then retries in the new
+ *   array. Lookups finding a frozen value not moved yet return it: no
+ *   update of the key can have been done in the new array before the
+ *   slot is marked as moved.
+ * - Once every slot has been moved, the new array is published as the
+ *   table array with RCU, and the old one is freed after a grace period
+ *   with the flavor call_rcu. Readers and updaters which loaded the old
+ *   array follow its "next" pointer.
+ */
+
+#define _LGPL_SOURCE
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include <urcu.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/compiler.h>
+#include <urcu/rculfoht.h>
+
+#if (CAA_BITS_PER_LONG == 64)
+
+#define LFOHT_MIN_SIZE		8UL
+
+/*
+ * Resize when three quarters of the slots have been used. The new array
+ * is sized for four times the number of entries.
+ */
+#define LFOHT_MAX_USED(size)	((size) - ((size) >> 2))
+#define LFOHT_GROWTH		4
+
+#define KEY_EMPTY		0ULL
+#define KEY_FROZEN		(~0ULL)
+
+#define VALUE_FROZEN		(1ULL << 63)
+#define VALUE_NONE		(VALUE_FROZEN - 1)	/* Deleted or moved. */
+#define VALUE_UNSET		(VALUE_FROZEN - 2)	/* Never set. */
+
+struct lfoht_slot {
+	uint64_t key;
+	uint64_t value;
+};
+
+struct lfoht_table {
+	unsigned long size;		/* Number of slots, power of two. */
+	unsigned long nr_used;		/* Slots with a key. */
+	long count;			/* Slots with a value. */
+	int moved;			/* All slots moved to next. */
+	struct lfoht_table *next;	/* Resize target, RCU-published. */
+	struct rcu_head head;
+	struct lfoht_slot slots[];
+};
+
+struct cds_lfoht {
+	struct lfoht_table *table;	/* RCU-published. */
+	const struct rcu_flavor_struct *flavor;
+};
+
+enum lfoht_put_mode {
+	LFOHT_PUT_ADD,
+	LFOHT_PUT_DEL,
+	LFOHT_PUT_COPY,
+};
+
+static
+int lfoht_put(struct cds_lfoht *ht, struct lfoht_table *t,
+		uint64_t key, uint64_t value, enum lfoht_put_mode mode);
+
+/* 64-bit finalizer of MurmurHash3. */
+static inline
+unsigned long lfoht_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+static inline
+int lfoht_key_valid(uint64_t key)
+{
+	return key != KEY_EMPTY && key != KEY_FROZEN;
+}
+
+static inline
+int lfoht_value_set(uint64_t value)
+{
+	return value != VALUE_NONE && value != VALUE_UNSET;
+}
+
+static
+struct lfoht_table *lfoht_table_alloc(unsigned long size)
+{
+	struct lfoht_table *t;
+	unsigned long i;
+
+	t = calloc(1, sizeof(*t) + size * sizeof(t->slots[0]));
+	assert(t);
+	t->size = size;
+	for (i = 0; i < size; i++)
+		t->slots[i].value = VALUE_UNSET;
+	return t;
+}
+
+static
+void lfoht_table_free_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct lfoht_table, head));
+}
+
+/*
+ * Find the slot of a key, claiming an empty slot for it if claim is
+ * set. Return NULL if the key is not in the array, which is either
+ * because the array is full, or because it is being moved and the key
+ * can only be found in the next one.
+ */
+static
+struct lfoht_slot *lfoht_find(struct lfoht_table *t, uint64_t key,
+		int claim)
+{
+	unsigned long mask = t->size - 1, i, n;
+	struct lfoht_slot *slot;
+	uint64_t k;
+
+	i = lfoht_hash(key) & mask;
+	for (n = 0; n < t->size; n++, i = (i + 1) & mask) {
+		slot = &t->slots[i];
+		k = CMM_LOAD_SHARED(slot->key);
+		if (k == KEY_EMPTY && claim) {
+			k = uatomic_cmpxchg(&slot->key, KEY_EMPTY, key);
+			if (k == KEY_EMPTY) {
+				uatomic_inc(&t->nr_used);
+				return slot;
+			}
+		}
+		if (k == key)
+			return slot;
+		if (k == KEY_EMPTY || k == KEY_FROZEN)
+			return NULL;
+	}
+	return NULL;
+}
+
+/*
+ * Move a slot to the next array. Steps are idempotent and can be
+ * performed concurrently by several threads.
+ */
+static
+void lfoht_move_slot(struct cds_lfoht *ht, struct lfoht_table *t,
+		struct lfoht_slot *slot)
+{
+	uint64_t key, value, old;
+
+	key = uatomic_cmpxchg(&slot->key, KEY_EMPTY, KEY_FROZEN);
+	if (key == KEY_EMPTY || key == KEY_FROZEN)
+		return;
+	value = uatomic_read(&slot->value);
+	while (!(value & VALUE_FROZEN)) {
+		old = uatomic_cmpxchg(&slot->value, value,
+				value | VALUE_FROZEN);
+		if (old == value)
+			value |= VALUE_FROZEN;
+		else
+			value = old;
+	}
+	if (value == (VALUE_FROZEN | VALUE_NONE))
+		return;
+	if (value != (VALUE_FROZEN | VALUE_UNSET))
+		(void) lfoht_put(ht, rcu_dereference(t->next), key,
+				value & ~VALUE_FROZEN, LFOHT_PUT_COPY);
+	(void) uatomic_cmpxchg(&slot->value, value,
+			VALUE_FROZEN | VALUE_NONE);
+}
+
+/*
+ * Publish the first array which is not entirely moved, freeing the
+ * ones before it after a grace period.
+ */
+static
+void lfoht_publish(struct cds_lfoht *ht)
+{
+	struct lfoht_table *t;
+
+	for (;;) {
+		t = rcu_dereference(ht->table);
+		if (!uatomic_read(&t->moved))
+			return;
+		if (uatomic_cmpxchg(&ht->table, t, t->next) == t)
+			ht->flavor->update_call_rcu(&t->head,
+					lfoht_table_free_rcu);
+	}
+}
+
+/*
+ * Move all slots of an array to the next one, allocating it if needed.
+ * Return the next array.
+ */
+static
+struct lfoht_table *lfoht_resize(struct cds_lfoht *ht, struct lfoht_table *t)
+{
+	struct lfoht_table *next, *new;
+	unsigned long size, i;
+	long count;
+
+	next = rcu_dereference(t->next);
+	if (!next) {
+		count = uatomic_read(&t->count);
+		if (count < 0)
+			count = 0;
+		for (size = LFOHT_MIN_SIZE; size < LFOHT_GROWTH * count;)
+			size <<= 1;
+		new = lfoht_table_alloc(size);
+		next = uatomic_cmpxchg(&t->next, NULL, new);
+		if (next)
+			free(new);
+		else
+			next = new;
+	}
+	for (i = 0; i < t->size; i++)
+		lfoht_move_slot(ht, t, &t->slots[i]);
+	uatomic_set(&t->moved, 1);
+	/* Order the moved store before the load of the table array. */
+	cmm_smp_mb();
+	lfoht_publish(ht);
+	return next;
+}
+
+static
+int lfoht_put(struct cds_lfoht *ht, struct lfoht_table *t,
+		uint64_t key, uint64_t value, enum lfoht_put_mode mode)
+{
+	struct lfoht_table *next;
+	struct lfoht_slot *slot;
+	uint64_t old, new, cur;
+
+	for (;;) {
+		slot = lfoht_find(t, key, mode != LFOHT_PUT_DEL);
+		if (!slot) {
+			next = rcu_dereference(t->next);
+			if (!next) {
+				if (mode == LFOHT_PUT_DEL)
+					return -ENOENT;
+				next = lfoht_resize(ht, t);
+			}
+			t = next;
+			continue;
+		}
+		old = uatomic_read(&slot->value);
+	retry:
+		if (old & VALUE_FROZEN) {
+			/* Complete the move, then update the next array. */
+			lfoht_move_slot(ht, t, slot);
+			t = rcu_dereference(t->next);
+			continue;
+		}
+		switch (mode) {
+		case LFOHT_PUT_ADD:
+			if (lfoht_value_set(old))
+				return -EEXIST;
+			new = value;
+			break;
+		case LFOHT_PUT_DEL:
+			if (!lfoht_value_set(old))
+				return -ENOENT;
+			new = VALUE_NONE;
+			break;
+		case LFOHT_PUT_COPY:
+			/* Never overwrite an update done after the move. */
+			if (old != VALUE_UNSET)
+				return 0;
+			new = value;
+			break;
+		default:
+			assert(0);
+		}
+		cur = uatomic_cmpxchg(&slot->value, old, new);
+		if (cur != old) {
+			old = cur;
+			goto retry;
+		}
+		if (mode == LFOHT_PUT_DEL) {
+			uatomic_dec(&t->count);
+			return 0;
+		}
+		uatomic_inc(&t->count);
+		if (mode == LFOHT_PUT_ADD
+		    && uatomic_read(&t->nr_used) >= LFOHT_MAX_USED(t->size)
+		    && !rcu_dereference(t->next))
+			(void) lfoht_resize(ht, t);
+		return 0;
+	}
+}
+
+struct cds_lfoht *_cds_lfoht_new(unsigned long init_size,
+			const struct rcu_flavor_struct *flavor)
+{
+	struct cds_lfoht *ht;
+
+	/* init_size must be power of two */
+	if (!init_size || (init_size & (init_size - 1)))
+		return NULL;
+
+	ht = calloc(1, sizeof(*ht));
+	assert(ht);
+	ht->flavor = flavor;
+	if (init_size < LFOHT_MIN_SIZE)
+		init_size = LFOHT_MIN_SIZE;
+	ht->table = lfoht_table_alloc(init_size);
+	return ht;
+}
+
+int cds_lfoht_destroy(struct cds_lfoht *ht)
+{
+	struct lfoht_table *t, *next;
+
+	/* Resizes complete before returning to the caller. */
+	for (t = ht->table; t; t = next) {
+		next = t->next;
+		free(t);
+	}
+	free(ht);
+	return 0;
+}
+
+int cds_lfoht_lookup(struct cds_lfoht *ht, uint64_t key, uint64_t *value)
+{
+	struct lfoht_table *t;
+	struct lfoht_slot *slot;
+	uint64_t v;
+
+	if (!lfoht_key_valid(key))
+		return -EINVAL;
+	for (t = rcu_dereference(ht->table); t; t = rcu_dereference(t->next)) {
+		slot = lfoht_find(t, key, 0);
+		if (!slot)
+			continue;
+		v = CMM_LOAD_SHARED(slot->value);
+		if (!(v & VALUE_FROZEN)) {
+			if (!lfoht_value_set(v))
+				return -ENOENT;
+			*value = v;
+			return 0;
+		}
+		/* Frozen, but not moved yet: still the latest value. */
+		v &= ~VALUE_FROZEN;
+		if (lfoht_value_set(v)) {
+			*value = v;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+int cds_lfoht_add(struct cds_lfoht *ht, uint64_t key, uint64_t value)
+{
+	if (!lfoht_key_valid(key) || value > CDS_LFOHT_VALUE_MAX)
+		return -EINVAL;
+	return lfoht_put(ht, rcu_dereference(ht->table), key, value,
+			LFOHT_PUT_ADD);
+}
+
+int cds_lfoht_del(struct cds_lfoht *ht, uint64_t key)
+{
+	if (!lfoht_key_valid(key))
+		return -EINVAL;
+	return lfoht_put(ht, rcu_dereference(ht->table), key, 0,
+			LFOHT_PUT_DEL);
+}
+
+#endif /* #if (CAA_BITS_PER_LONG == 64) */
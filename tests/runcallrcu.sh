@@ -0,0 +1,14 @@
+#!/bin/sh
+
+# Run the call_rcu feature tests, for each flavor they are built for.
+# Each test checks its own results and exits with an error on failure.
+
+TESTS="call_rcu_batch barrier call_rcu_pool call_rcu_backlog \
+	call_rcu_bulk call_rcu_eventfd"
+
+for test in ${TESTS}; do
+	for flavor in urcu urcu_qsbr; do
+		echo "./test_${flavor}_${test}"
+		./test_${flavor}_${test} || exit 1
+	done
+done
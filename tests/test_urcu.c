@@ -33,9 +33,11 @@
 #include <assert.h>
 #include <sched.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <urcu/arch.h>
 #include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
 
 #ifdef __linux__
 #include <syscall.h>
@@ -64,7 +66,14 @@ static inline pid_t gettid(void)
 #else
 #define rcu_debug_yield_read()
 #endif
+#ifdef RCU_AUTO
+#ifndef DYNAMIC_LINK_TEST
+#define rcu_debug_yield_read()
+#endif
+#include <urcu-auto.h>
+#else
 #include <urcu.h>
+#endif
 
 struct test_array {
 	int a;
@@ -84,6 +93,23 @@ static unsigned long rduration;
 /* write-side C.S. duration, in loops */
 static unsigned long wduration;
 
+/*
+ * Multi-writer mode: writers only hold the update mutex while swapping
+ * the pointer, so their synchronize_rcu() calls run concurrently.
+ */
+static int multi_writer;
+
+/* Grace periods are performed by the grace period driver thread. */
+static int gp_driver;
+
+/*
+ * Many-thread mode: registered reader threads which stay out of
+ * read-side critical sections, so grace periods only pay for scanning
+ * them.
+ */
+static unsigned int nr_idle_readers;
+static int nr_idle_registered;
+
 static inline void loop_sleep(unsigned long loops)
 {
 	while (loops-- != 0)
@@ -264,6 +290,16 @@ void *thr_reader(void *_count)
 
 }
 
+void *thr_idle_reader(void *arg)
+{
+	rcu_register_thread();
+	uatomic_inc(&nr_idle_registered);
+	while (!test_stop)
+		poll(NULL, 0, 100);
+	rcu_unregister_thread();
+	return NULL;
+}
+
 void *thr_writer(void *_count)
 {
 	unsigned long long *count = _count;
@@ -285,13 +321,16 @@ void *thr_writer(void *_count)
 		new = test_array_alloc();
 		new->a = 8;
 		old = rcu_xchg_pointer(&test_rcu_pointer, new);
+		if (caa_unlikely(multi_writer))
+			rcu_copy_mutex_unlock();
 		if (caa_unlikely(wduration))
 			loop_sleep(wduration);
 		synchronize_rcu();
 		if (old)
 			old->a = 0;
 		test_array_free(old);
-		rcu_copy_mutex_unlock();
+		if (caa_likely(!multi_writer))
+			rcu_copy_mutex_unlock();
 		URCU_TLS(nr_writes)++;
 		if (caa_unlikely(!test_duration_write()))
 			break;
@@ -306,6 +345,29 @@ void *thr_writer(void *_count)
 	return ((void*)2);
 }
 
+/*
+ * Every write waits for a grace period, possibly shared with other
+ * writers.
+ */
+static void check_gp_stats(unsigned long long tot_writes)
+{
+	struct rcu_gp_stats stats;
+	unsigned long hist_sum = 0;
+	int i;
+
+	rcu_get_gp_stats(&stats);
+	for (i = 0; i < RCU_GP_STATS_HIST_LEN; i++)
+		hist_sum += stats.duration_hist[i];
+	printf_verbose("grace periods %lu, scans %lu (max %lu), "
+		"futex waits %lu, mb master %lu\n",
+		stats.nr_gp, stats.nr_scans, stats.max_scans,
+		stats.nr_futex_wait, stats.nr_mb_master);
+	if (hist_sum != stats.nr_gp || (tot_writes && !stats.nr_gp)) {
+		fprintf(stderr, "Inconsistent grace period statistics\n");
+		exit(1);
+	}
+}
+
 void show_usage(int argc, char **argv)
 {
 	printf("Usage : %s nr_readers nr_writers duration (s)", argv[0]);
@@ -315,6 +377,9 @@ void show_usage(int argc, char **argv)
 	printf(" [-d delay] (writer period (us))");
 	printf(" [-c duration] (reader C.S. duration (in loops))");
 	printf(" [-e duration] (writer C.S. duration (in loops))");
+	printf(" [-m] (multi-writer: concurrent synchronize_rcu())");
+	printf(" [-i nr_idle] (idle registered readers)");
+	printf(" [-g] (grace period driver thread)");
 	printf(" [-v] (verbose output)");
 	printf(" [-a cpu#] [-a cpu#]... (affinity)");
 	printf("\n");
@@ -323,7 +388,7 @@ void show_usage(int argc, char **argv)
 int main(int argc, char **argv)
 {
 	int err;
-	pthread_t *tid_reader, *tid_writer;
+	pthread_t *tid_reader, *tid_writer, *tid_idle_reader;
 	void *tret;
 	unsigned long long *count_reader, *count_writer;
 	unsigned long long tot_reads = 0, tot_writes = 0;
@@ -395,6 +460,19 @@ int main(int argc, char **argv)
 			}
 			wduration = atol(argv[++i]);
 			break;
+		case 'm':
+			multi_writer = 1;
+			break;
+		case 'i':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_idle_readers = atol(argv[++i]);
+			break;
+		case 'g':
+			gp_driver = 1;
+			break;
 		case 'v':
 			verbose_mode = 1;
 			break;
@@ -405,6 +483,11 @@ int main(int argc, char **argv)
 		duration, nr_readers, nr_writers);
 	printf_verbose("Writer delay : %lu loops.\n", wdelay);
 	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Grace period driver : %s.\n",
+			gp_driver ? "enabled" : "disabled");
+	printf_verbose("Multi-writer mode : %s.\n",
+			multi_writer ? "enabled" : "disabled");
+	printf_verbose("Idle readers : %u.\n", nr_idle_readers);
 	printf_verbose("thread %-6s, thread id : %lx, tid %lu\n",
 			"main", (unsigned long) pthread_self(),
 			(unsigned long)gettid());
@@ -412,11 +495,21 @@ int main(int argc, char **argv)
 	test_array = calloc(1, sizeof(*test_array) * ARRAY_SIZE);
 	tid_reader = malloc(sizeof(*tid_reader) * nr_readers);
 	tid_writer = malloc(sizeof(*tid_writer) * nr_writers);
+	tid_idle_reader = malloc(sizeof(*tid_idle_reader) * nr_idle_readers);
 	count_reader = malloc(sizeof(*count_reader) * nr_readers);
 	count_writer = malloc(sizeof(*count_writer) * nr_writers);
 
 	next_aff = 0;
 
+	for (i = 0; i < nr_idle_readers; i++) {
+		err = pthread_create(&tid_idle_reader[i], NULL, thr_idle_reader,
+				     NULL);
+		if (err != 0)
+			exit(1);
+	}
+	while (uatomic_read(&nr_idle_registered) < nr_idle_readers)
+		poll(NULL, 0, 1);
+
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_create(&tid_reader[i], NULL, thr_reader,
 				     &count_reader[i]);
@@ -430,6 +523,9 @@ int main(int argc, char **argv)
 			exit(1);
 	}
 
+	if (gp_driver)
+		rcu_gp_driver_start();
+
 	cmm_smp_mb();
 
 	test_go = 1;
@@ -450,9 +546,16 @@ int main(int argc, char **argv)
 			exit(1);
 		tot_writes += count_writer[i];
 	}
+	rcu_gp_driver_stop();
+	for (i = 0; i < nr_idle_readers; i++) {
+		err = pthread_join(tid_idle_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+	}
 	
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
+	check_gp_stats(tot_writes);
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
@@ -463,6 +566,7 @@ int main(int argc, char **argv)
 	free(test_array);
 	free(tid_reader);
 	free(tid_writer);
+	free(tid_idle_reader);
 	free(count_reader);
 	free(count_writer);
 	return 0;
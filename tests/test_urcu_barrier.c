@@ -0,0 +1,79 @@
+/*
+ * test_urcu_barrier.c
+ *
+ * Userspace RCU library - rcu_barrier() test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "test_urcu_call_rcu.h"
+
+/* One call_rcu_data per enqueuer thread, NULL for the default one. */
+static struct call_rcu_data *crdp[NR_THREADS];
+
+static void *thr_enqueuer(void *arg)
+{
+	struct call_rcu_data *thread_crdp = *(struct call_rcu_data **) arg;
+	int i;
+
+	rcu_register_thread();
+	set_thread_call_rcu_data(thread_crdp);
+	for (i = 0; i < NR_CBS; i++)
+		call_rcu(&test_cb_alloc()->rcu, test_cb_func);
+	/* Leave the batch attached: rcu_barrier() must flush it. */
+	rcu_barrier();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t tid[NR_THREADS];
+	unsigned long expected = 0;
+	int err, i, round;
+
+	crdp[1] = create_call_rcu_data(0, -1);
+	crdp[2] = create_call_rcu_data(URCU_CALL_RCU_BATCH, -1);
+	crdp[3] = create_call_rcu_data(URCU_CALL_RCU_BATCH
+			| URCU_CALL_RCU_BATCH_LATENCY(255), -1);
+
+	rcu_register_thread();
+	for (round = 0; round < 3; round++) {
+		rcu_thread_offline();
+		for (i = 0; i < NR_THREADS; i++) {
+			err = pthread_create(&tid[i], NULL, thr_enqueuer,
+					&crdp[i]);
+			if (err != 0)
+				exit(1);
+		}
+		for (i = 0; i < NR_THREADS; i++) {
+			err = pthread_join(tid[i], NULL);
+			if (err != 0)
+				exit(1);
+		}
+		rcu_thread_online();
+		/* Also from an online QSBR thread. */
+		rcu_barrier();
+		expected += NR_THREADS * NR_CBS;
+		check_invoked(expected);
+	}
+	rcu_unregister_thread();
+	printf("%lu callbacks invoked before rcu_barrier() returned\n",
+		expected);
+
+	for (i = 0; i < NR_THREADS; i++)
+		call_rcu_data_free(crdp[i]);
+	return 0;
+}
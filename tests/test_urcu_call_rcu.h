@@ -0,0 +1,78 @@
+#ifndef _TEST_URCU_CALL_RCU_H
+#define _TEST_URCU_CALL_RCU_H
+
+/*
+ * test_urcu_call_rcu.h
+ *
+ * Userspace RCU library - common fixture of the call_rcu tests
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+
+#define _LGPL_SOURCE
+#ifdef RCU_QSBR
+#include <urcu-qsbr.h>
+#else
+#include <urcu.h>
+#endif
+
+/* Number of enqueuer threads, and of callbacks queued by each. */
+#define NR_THREADS	4
+#ifndef NR_CBS
+#define NR_CBS		10000
+#endif
+
+struct test_cb {
+	struct rcu_head rcu;
+	pthread_t owner;	/* Thread which queued the callback */
+};
+
+static unsigned long nr_invoked;
+
+static inline struct test_cb *test_cb_alloc(void)
+{
+	struct test_cb *cb;
+
+	cb = malloc(sizeof(*cb));
+	if (!cb)
+		abort();
+	cb->owner = pthread_self();
+	return cb;
+}
+
+static inline void test_cb_func(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct test_cb, rcu));
+	uatomic_inc(&nr_invoked);
+}
+
+/* Exit with an error unless expected callbacks have been invoked. */
+static inline void check_invoked(unsigned long expected)
+{
+	if (uatomic_read(&nr_invoked) != expected) {
+		fprintf(stderr, "rcu_barrier() returned with %lu of %lu callbacks invoked\n",
+			uatomic_read(&nr_invoked), expected);
+		exit(1);
+	}
+}
+
+#endif /* _TEST_URCU_CALL_RCU_H */
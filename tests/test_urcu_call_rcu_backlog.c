@@ -0,0 +1,112 @@
+/*
+ * test_urcu_call_rcu_backlog.c
+ *
+ * Userspace RCU library - call_rcu backlog limit test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define NR_CBS		100000
+#include "test_urcu_call_rcu.h"
+
+#define EXPEDITE	1000
+#define LIMIT		5000
+#define BATCH		100
+
+static struct call_rcu_data *crdp;
+static unsigned long nr_queued, max_backlog;
+
+static void *thr_enqueuer(void *arg)
+{
+	unsigned long backlog, max;
+	int i;
+
+	rcu_register_thread();
+	set_thread_call_rcu_data(crdp);
+#ifdef RCU_QSBR
+	/* Online QSBR threads are never throttled. */
+	rcu_thread_offline();
+#endif
+	for (i = 0; i < NR_CBS; i++) {
+		uatomic_inc(&nr_queued);
+		call_rcu(&test_cb_alloc()->rcu, test_cb_func);
+		backlog = uatomic_read(&nr_queued) - uatomic_read(&nr_invoked);
+		while ((max = uatomic_read(&max_backlog)) < backlog)
+			uatomic_cmpxchg(&max_backlog, max, backlog);
+	}
+#ifdef RCU_QSBR
+	rcu_thread_online();
+#endif
+	set_thread_call_rcu_data(NULL);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static unsigned long run(unsigned long flags, unsigned long expedite,
+		unsigned long limit)
+{
+	pthread_t tid[NR_THREADS];
+	int err, i;
+
+	crdp = create_call_rcu_data(flags, -1);
+	set_call_rcu_data_backlog(crdp, expedite, limit);
+	uatomic_set(&max_backlog, 0);
+	for (i = 0; i < NR_THREADS; i++) {
+		err = pthread_create(&tid[i], NULL, thr_enqueuer, NULL);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < NR_THREADS; i++) {
+		err = pthread_join(tid[i], NULL);
+		if (err != 0)
+			exit(1);
+	}
+	rcu_barrier();
+	check_invoked(uatomic_read(&nr_queued));
+	call_rcu_data_free(crdp);
+	return uatomic_read(&max_backlog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long backlog;
+
+	backlog = run(0, 0, 0);
+	printf("No backlog limit: at most %lu callbacks pending\n", backlog);
+	backlog = run(0, EXPEDITE, LIMIT);
+	printf("Backlog limit %d: at most %lu callbacks pending\n",
+		LIMIT, backlog);
+	/*
+	 * Each enqueuer may overshoot by one callback, and be counted in
+	 * nr_queued before queueing another.
+	 */
+	if (backlog > LIMIT + 2 * NR_THREADS) {
+		fprintf(stderr, "Backlog exceeded its limit\n");
+		exit(1);
+	}
+	backlog = run(URCU_CALL_RCU_BATCH | URCU_CALL_RCU_BATCH_SIZE(BATCH),
+		EXPEDITE, LIMIT);
+	printf("Batched, backlog limit %d: at most %lu callbacks pending\n",
+		LIMIT, backlog);
+	/*
+	 * Batches are accounted once full: each enqueuer may also hold a
+	 * batch being filled, and overshoot by the batch it moved.
+	 */
+	if (backlog > LIMIT + 2 * (BATCH + 1) * NR_THREADS) {
+		fprintf(stderr, "Batched backlog exceeded its limit\n");
+		exit(1);
+	}
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * test_urcu_call_rcu_batch.c
+ *
+ * Userspace RCU library - batched call_rcu test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <poll.h>
+
+/* Not a multiple of BATCH_SIZE: exiting threads leave partial batches. */
+#define NR_CBS		1000
+#include "test_urcu_call_rcu.h"
+
+#define BATCH_SIZE	64
+#define LATENCY_MS	20
+/* Longest wait accepted for callbacks, in ms. */
+#define TIMEOUT_MS	5000
+
+static struct call_rcu_data *crdp;
+
+static void queue_cb(void)
+{
+	call_rcu(&test_cb_alloc()->rcu, test_cb_func);
+}
+
+static void *thr_enqueuer(void *arg)
+{
+	int i;
+
+	rcu_register_thread();
+	set_thread_call_rcu_data(crdp);
+	for (i = 0; i < NR_CBS; i++)
+		queue_cb();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/* Wait for nr_invoked to reach count, returning the time waited in ms. */
+static int wait_invoked(unsigned long count)
+{
+	int ms;
+
+	for (ms = 0; ms < TIMEOUT_MS; ms++) {
+		if (uatomic_read(&nr_invoked) >= count)
+			break;
+		poll(NULL, 0, 1);
+	}
+	return ms;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t tid[NR_THREADS];
+	unsigned long expected;
+	int err, i, ms;
+
+	crdp = create_call_rcu_data(URCU_CALL_RCU_BATCH
+			| URCU_CALL_RCU_BATCH_SIZE(BATCH_SIZE)
+			| URCU_CALL_RCU_BATCH_LATENCY(LATENCY_MS), -1);
+
+	/* A lone callback must not wait for its batch to fill up. */
+	rcu_register_thread();
+	set_thread_call_rcu_data(crdp);
+	queue_cb();
+	rcu_thread_offline();
+	ms = wait_invoked(1);
+	printf("Lone callback invoked after %d ms\n", ms);
+	if (ms >= TIMEOUT_MS) {
+		fprintf(stderr, "Lone callback not invoked\n");
+		exit(1);
+	}
+
+	for (i = 0; i < NR_THREADS; i++) {
+		err = pthread_create(&tid[i], NULL, thr_enqueuer, NULL);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < NR_THREADS; i++) {
+		err = pthread_join(tid[i], NULL);
+		if (err != 0)
+			exit(1);
+	}
+	expected = 1 + NR_THREADS * NR_CBS;
+	ms = wait_invoked(expected);
+	printf("%lu of %lu callbacks invoked, %d ms after enqueuers exited\n",
+		uatomic_read(&nr_invoked), expected, ms);
+	if (ms >= TIMEOUT_MS) {
+		fprintf(stderr, "Callbacks of exited threads not invoked\n");
+		exit(1);
+	}
+
+	rcu_thread_online();
+	set_thread_call_rcu_data(NULL);
+	rcu_unregister_thread();
+	call_rcu_data_free(crdp);
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * test_urcu_call_rcu_bulk.c
+ *
+ * Userspace RCU library - call_rcu_bulk() test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <time.h>
+
+#define NR_CBS		100000
+#include "test_urcu_call_rcu.h"
+
+#define BULK_MAX	64
+
+static struct call_rcu_data *crdp[2];
+
+struct enqueuer {
+	struct call_rcu_data *crdp;
+	int bulk;
+	double elapsed;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Allocate all callbacks up front so that only enqueue is timed. Bulk
+ * enqueuers flush arrays of 1 to BULK_MAX callbacks.
+ */
+static void *thr_enqueuer(void *arg)
+{
+	struct enqueuer *enqueuer = arg;
+	struct test_cb **cbs;
+	struct rcu_head *heads[BULK_MAX];
+	unsigned long i, nr = 0, size = 1;
+	double start;
+
+	cbs = malloc(NR_CBS * sizeof(*cbs));
+	if (!cbs)
+		abort();
+	for (i = 0; i < NR_CBS; i++)
+		cbs[i] = test_cb_alloc();
+	rcu_register_thread();
+	set_thread_call_rcu_data(enqueuer->crdp);
+	start = now();
+	for (i = 0; i < NR_CBS; i++) {
+		if (!enqueuer->bulk) {
+			call_rcu(&cbs[i]->rcu, test_cb_func);
+			continue;
+		}
+		heads[nr++] = &cbs[i]->rcu;
+		if (nr == size) {
+			call_rcu_bulk(heads, nr, test_cb_func);
+			nr = 0;
+			size = size % BULK_MAX + 1;
+		}
+	}
+	call_rcu_bulk(heads, nr, test_cb_func);
+	enqueuer->elapsed = now() - start;
+	rcu_barrier();
+	set_thread_call_rcu_data(NULL);
+	rcu_unregister_thread();
+	free(cbs);
+	return NULL;
+}
+
+static double run(struct call_rcu_data *crdp, int bulk)
+{
+	struct enqueuer enqueuers[NR_THREADS];
+	pthread_t tid[NR_THREADS];
+	unsigned long expected;
+	double elapsed = 0;
+	int err, i;
+
+	expected = uatomic_read(&nr_invoked) + NR_THREADS * NR_CBS;
+	for (i = 0; i < NR_THREADS; i++) {
+		enqueuers[i].crdp = crdp;
+		enqueuers[i].bulk = bulk;
+		err = pthread_create(&tid[i], NULL, thr_enqueuer,
+				&enqueuers[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < NR_THREADS; i++) {
+		err = pthread_join(tid[i], NULL);
+		if (err != 0)
+			exit(1);
+		elapsed += enqueuers[i].elapsed;
+	}
+	check_invoked(expected);
+	return elapsed * 1e9 / (NR_THREADS * NR_CBS);
+}
+
+int main(int argc, char **argv)
+{
+	const char *names[2] = { "queue", "batch" };
+	int i;
+
+	crdp[0] = create_call_rcu_data(0, -1);
+	crdp[1] = create_call_rcu_data(URCU_CALL_RCU_BATCH, -1);
+	for (i = 0; i < 2; i++) {
+		printf("%s: call_rcu %.1f ns/callback, ", names[i],
+			run(crdp[i], 0));
+		printf("call_rcu_bulk %.1f ns/callback\n", run(crdp[i], 1));
+	}
+	for (i = 0; i < 2; i++)
+		call_rcu_data_free(crdp[i]);
+	return 0;
+}
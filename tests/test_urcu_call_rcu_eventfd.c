@@ -0,0 +1,94 @@
+/*
+ * test_urcu_call_rcu_eventfd.c
+ *
+ * Userspace RCU library - event loop call_rcu delivery test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <poll.h>
+
+#include "test_urcu_call_rcu.h"
+
+/* One shard per enqueuer thread. */
+#define NR_SHARDS	NR_THREADS
+/* Longest wait accepted for the event file descriptor, in ms. */
+#define TIMEOUT_MS	5000
+
+static unsigned long nr_misplaced;
+
+static void test_shard_cb_func(struct rcu_head *head)
+{
+	struct test_cb *cb = caa_container_of(head, struct test_cb, rcu);
+
+	if (!pthread_equal(cb->owner, pthread_self()))
+		uatomic_inc(&nr_misplaced);
+	test_cb_func(head);
+}
+
+/* A single-threaded shard running its own callbacks from its loop. */
+static void *thr_shard(void *arg)
+{
+	struct call_rcu_data *crdp;
+	struct pollfd pfd;
+	unsigned long done = 0;
+	int i, ret;
+
+	rcu_register_thread();
+	crdp = create_call_rcu_data_eventfd(URCU_CALL_RCU_BATCH, -1);
+	set_thread_call_rcu_data(crdp);
+	for (i = 0; i < NR_CBS; i++)
+		call_rcu(&test_cb_alloc()->rcu, test_shard_cb_func);
+	pfd.fd = get_call_rcu_eventfd(crdp);
+	pfd.events = POLLIN;
+	while (done < NR_CBS) {
+		rcu_thread_offline();
+		ret = poll(&pfd, 1, TIMEOUT_MS);
+		rcu_thread_online();
+		if (ret <= 0) {
+			fprintf(stderr, "Event file descriptor not readable, %lu of %d callbacks run\n",
+				done, NR_CBS);
+			exit(1);
+		}
+		done += call_rcu_run_ready(crdp);
+	}
+	set_thread_call_rcu_data(NULL);
+	call_rcu_data_free(crdp);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t tid[NR_SHARDS];
+	int err, i;
+
+	for (i = 0; i < NR_SHARDS; i++) {
+		err = pthread_create(&tid[i], NULL, thr_shard, NULL);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < NR_SHARDS; i++) {
+		err = pthread_join(tid[i], NULL);
+		if (err != 0)
+			exit(1);
+	}
+	printf("%lu callbacks run, %lu on another thread than their shard\n",
+		uatomic_read(&nr_invoked), uatomic_read(&nr_misplaced));
+	if (uatomic_read(&nr_invoked) != NR_SHARDS * NR_CBS
+	    || uatomic_read(&nr_misplaced))
+		exit(1);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * test_urcu_call_rcu_pool.c
+ *
+ * Userspace RCU library - call_rcu helper pool reclamation benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+
+#define _LGPL_SOURCE
+#ifdef RCU_QSBR
+#include <urcu-qsbr.h>
+#else
+#include <urcu.h>
+#endif
+
+/*
+ * Each callback tears down a graph of graph_size nodes, spending
+ * node_work loop iterations per node, as a destructor would.
+ */
+struct test_node {
+	struct test_node *next;
+	unsigned long val;
+};
+
+struct test_graph {
+	struct rcu_head rcu;
+	struct test_node *nodes;
+};
+
+static unsigned long nr_cbs = 10000;
+static unsigned long graph_size = 32;
+static unsigned long node_work = 200;
+static int max_helpers = 7;
+
+static unsigned long nr_invoked;
+
+static void test_graph_free(struct rcu_head *head)
+{
+	struct test_graph *graph = caa_container_of(head, struct test_graph,
+			rcu);
+	struct test_node *node, *next;
+	unsigned long i;
+
+	for (node = graph->nodes; node; node = next) {
+		next = node->next;
+		for (i = 0; i < node_work; i++)
+			CMM_STORE_SHARED(node->val, node->val * 31 + i);
+		free(node);
+	}
+	free(graph);
+	uatomic_inc(&nr_invoked);
+}
+
+static struct test_graph *test_graph_alloc(void)
+{
+	struct test_graph *graph;
+	struct test_node *node;
+	unsigned long i;
+
+	graph = malloc(sizeof(*graph));
+	if (!graph)
+		abort();
+	graph->nodes = NULL;
+	for (i = 0; i < graph_size; i++) {
+		node = malloc(sizeof(*node));
+		if (!node)
+			abort();
+		node->val = i;
+		node->next = graph->nodes;
+		graph->nodes = node;
+	}
+	return graph;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the number of callbacks reclaimed per second. */
+static double run(int nr_helpers)
+{
+	struct call_rcu_data *crdp;
+	struct test_graph **graphs;
+	unsigned long i, expected;
+	double start, elapsed;
+
+	graphs = malloc(nr_cbs * sizeof(*graphs));
+	if (!graphs)
+		abort();
+	for (i = 0; i < nr_cbs; i++)
+		graphs[i] = test_graph_alloc();
+	crdp = create_call_rcu_data(URCU_CALL_RCU_HELPERS(nr_helpers), -1);
+	set_thread_call_rcu_data(crdp);
+	expected = uatomic_read(&nr_invoked) + nr_cbs;
+
+	start = now();
+	for (i = 0; i < nr_cbs; i++)
+		call_rcu(&graphs[i]->rcu, test_graph_free);
+	rcu_barrier();
+	elapsed = now() - start;
+
+	if (uatomic_read(&nr_invoked) != expected) {
+		fprintf(stderr, "rcu_barrier() returned with %lu of %lu callbacks invoked\n",
+			uatomic_read(&nr_invoked), expected);
+		exit(1);
+	}
+	set_thread_call_rcu_data(NULL);
+	call_rcu_data_free(crdp);
+	free(graphs);
+	return nr_cbs / elapsed;
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s [nr_cbs] [graph_size] [node_work] [max_helpers]\n",
+		argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	double base = 0, rate;
+	int nr_helpers;
+
+	if (argc > 1)
+		nr_cbs = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		graph_size = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		node_work = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		max_helpers = atoi(argv[4]);
+	if (argc > 5 || !nr_cbs || max_helpers < 0 || max_helpers > 7) {
+		show_usage(argc, argv);
+		return 1;
+	}
+
+	rcu_register_thread();
+	printf("nr_cbs %lu graph_size %lu node_work %lu\n",
+		nr_cbs, graph_size, node_work);
+	for (nr_helpers = 0; nr_helpers <= max_helpers; nr_helpers++) {
+		rate = run(nr_helpers);
+		if (!nr_helpers)
+			base = rate;
+		printf("helpers %d: %.0f callbacks/s (x%.2f)\n",
+			nr_helpers, rate, rate / base);
+	}
+	rcu_unregister_thread();
+	return 0;
+}
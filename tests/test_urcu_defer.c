@@ -33,6 +33,9 @@
 #include <assert.h>
 #include <sched.h>
 #include <errno.h>
+#include <limits.h>
+#include <malloc.h>
+#include <poll.h>
 
 #include <urcu/arch.h>
 #include <urcu/tls-compat.h>
@@ -239,6 +242,131 @@ static void test_cb1(void *data)
 {
 }
 
+/*
+ * Entries of a segment of the defer queue, and default queue limit,
+ * as in urcu-defer-impl.h.
+ */
+#define DEFER_QUEUE_SIZE	(1 << 12)
+#define DEFER_QUEUE_LIMIT	(31 * DEFER_QUEUE_SIZE)
+
+/* Holds off the defer thread while queues are filled. */
+#define DEFER_TEST_DELAY	10000	/* ms */
+
+static unsigned long nr_deferred, nr_invoked;
+
+static void defer_check(int cond, const char *msg)
+{
+	if (!cond) {
+		fprintf(stderr, "[ERROR] %s\n", msg);
+		exit(1);
+	}
+}
+
+/* Callbacks must be invoked once each, in the order they were queued. */
+static void test_cb_seq(void *data)
+{
+	defer_check((unsigned long) data == uatomic_read(&nr_invoked) << 1,
+		"defer_rcu() callback invoked out of order");
+	uatomic_inc(&nr_invoked);
+}
+
+/* Queue nr callbacks, returning the largest number left pending. */
+static unsigned long defer_seq(unsigned long nr)
+{
+	unsigned long i, pending, max = 0;
+
+	for (i = 0; i < nr; i++) {
+		defer_rcu(test_cb_seq, (void *) (nr_deferred++ << 1));
+		pending = nr_deferred - uatomic_read(&nr_invoked);
+		if (pending > max)
+			max = pending;
+	}
+	return max;
+}
+
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC_PREREQ) && __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.uordblks + mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Reaching the batch threshold must end the batching delay of the defer
+ * thread: the callbacks are invoked well before the delay expires.
+ */
+static void test_defer_batch(void)
+{
+	unsigned long ms;
+
+	rcu_defer_set_batch(DEFER_QUEUE_SIZE / 2, DEFER_TEST_DELAY);
+	(void) defer_seq(DEFER_QUEUE_SIZE / 2);
+	for (ms = 0; uatomic_read(&nr_invoked) != nr_deferred; ms++) {
+		defer_check(ms < DEFER_TEST_DELAY / 2,
+			"batch threshold did not end the batching delay");
+		poll(NULL, 0, 1);
+	}
+	printf_verbose("defer batch test: callbacks invoked after %lu ms\n",
+		ms);
+}
+
+/*
+ * Segment chaining, queue limit and segment recycling, with the defer
+ * thread held off by the batching delay.
+ */
+static void test_defer_queue(void)
+{
+	unsigned long max;
+	size_t heap;
+
+	rcu_defer_set_batch(ULONG_MAX, DEFER_TEST_DELAY);
+
+	/* Without barrier, the queue grows past its first segment. */
+	(void) defer_seq(3 * DEFER_QUEUE_SIZE + 1);
+	defer_check(nr_deferred - uatomic_read(&nr_invoked)
+			== 3 * DEFER_QUEUE_SIZE + 1,
+		"callbacks invoked before reaching the queue limit");
+	rcu_defer_barrier_thread();
+	defer_check(uatomic_read(&nr_invoked) == nr_deferred,
+		"rcu_defer_barrier_thread left callbacks behind");
+
+	/*
+	 * Past the limit, defer_rcu() invokes the callbacks of its queue
+	 * itself, and the segments they used are reused for the next ones.
+	 */
+	rcu_defer_set_queue_limit(DEFER_QUEUE_SIZE);
+	heap = heap_in_use();
+	max = defer_seq(16 * DEFER_QUEUE_SIZE);
+	defer_check(uatomic_read(&nr_invoked) > 0,
+		"queue limit reached without invoking callbacks");
+	defer_check(max <= 2 * DEFER_QUEUE_SIZE,
+		"queue grew past its limit");
+	defer_check(heap_in_use() <= heap,
+		"defer queue segments were not recycled");
+	rcu_defer_barrier_thread();
+	defer_check(uatomic_read(&nr_invoked) == nr_deferred,
+		"rcu_defer_barrier_thread left callbacks behind");
+
+	printf_verbose("defer queue tests: %lu callbacks OK\n", nr_deferred);
+}
+
+/* A thread can only register once: run the tests in a thread of their own. */
+static void *thr_defer_test(void *arg)
+{
+	defer_check(!rcu_defer_register_thread(),
+		"rcu_defer_register_thread failed");
+	test_defer_batch();
+	test_defer_queue();
+	rcu_defer_set_queue_limit(DEFER_QUEUE_LIMIT);
+	rcu_defer_set_batch(DEFER_QUEUE_SIZE, 100);
+	rcu_defer_unregister_thread();
+	return NULL;
+}
+
 void *thr_writer(void *data)
 {
 	unsigned long wtidx = (unsigned long)data;
@@ -309,7 +437,7 @@ void show_usage(int argc, char **argv)
 int main(int argc, char **argv)
 {
 	int err;
-	pthread_t *tid_reader, *tid_writer;
+	pthread_t *tid_reader, *tid_writer, tid_test;
 	void *tret;
 	unsigned long long *count_reader;
 	unsigned long long tot_reads = 0, tot_writes = 0;
@@ -387,6 +515,13 @@ int main(int argc, char **argv)
 		}
 	}
 
+	err = pthread_create(&tid_test, NULL, thr_defer_test, NULL);
+	if (err != 0)
+		exit(1);
+	err = pthread_join(tid_test, &tret);
+	if (err != 0)
+		exit(1);
+
 	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
 		duration, nr_readers, nr_writers);
 	printf_verbose("Writer delay : %lu loops.\n", wdelay);
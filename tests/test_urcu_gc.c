@@ -33,6 +33,7 @@
 #include <assert.h>
 #include <sched.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <urcu/arch.h>
 #include <urcu/tls-compat.h>
@@ -68,6 +69,7 @@ static inline pid_t gettid(void)
 
 struct test_array {
 	int a;
+	struct rcu_head rcu;	/* free_rcu() mode */
 };
 
 static volatile int test_go, test_stop;
@@ -81,8 +83,18 @@ static unsigned int reclaim_batch = 1;
 struct reclaim_queue {
 	void **queue;	/* Beginning of queue */
 	void **head;	/* Insert position */
+	/* Polled mode: previous batch, awaiting its grace period */
+	void **waiting;
+	void **waiting_head;
+	unsigned long cookie;
 };
 
+/* Use polled grace periods rather than synchronize_rcu() */
+static int polled_reclaim;
+
+/* Use free_rcu() rather than a per-thread queue */
+static int free_rcu_reclaim;
+
 static struct reclaim_queue *pending_reclaims;
 
 static unsigned long duration;
@@ -239,26 +251,64 @@ void *thr_reader(void *_count)
 
 }
 
-static void rcu_gc_clear_queue(unsigned long wtidx)
+static void rcu_gc_free_batch(void **begin, void **end)
 {
 	void **p;
 
-	/* Wait for Q.S and empty queue */
-	synchronize_rcu();
-
-	for (p = pending_reclaims[wtidx].queue;
-			p < pending_reclaims[wtidx].head; p++) {
+	for (p = begin; p < end; p++) {
 		/* poison */
 		if (*p)
 			((struct test_array *)*p)->a = 0;
 		free(*p);
 	}
-	pending_reclaims[wtidx].head = pending_reclaims[wtidx].queue;
+}
+
+static void rcu_gc_clear_queue(unsigned long wtidx)
+{
+	struct reclaim_queue *rq = &pending_reclaims[wtidx];
+
+	/* Wait for Q.S and empty queue */
+	synchronize_rcu();
+
+	rcu_gc_free_batch(rq->queue, rq->head);
+	rq->head = rq->queue;
+	if (polled_reclaim) {
+		rcu_gc_free_batch(rq->waiting, rq->waiting_head);
+		rq->waiting_head = rq->waiting;
+	}
+}
+
+/*
+ * Polled mode: free the previous batch once its grace period is over,
+ * then start a grace period for the current batch without waiting.
+ */
+static void rcu_gc_poll_queue(unsigned long wtidx)
+{
+	struct reclaim_queue *rq = &pending_reclaims[wtidx];
+	void **tmp;
+
+	if (rq->waiting_head != rq->waiting) {
+		while (!poll_state_synchronize_rcu(rq->cookie))
+			poll(NULL, 0, 1);
+		rcu_gc_free_batch(rq->waiting, rq->waiting_head);
+	}
+	tmp = rq->waiting;
+	rq->waiting = rq->queue;
+	rq->waiting_head = rq->head;
+	rq->queue = tmp;
+	rq->head = tmp;
+	rq->cookie = start_poll_synchronize_rcu();
 }
 
 /* Using per-thread queue */
 static void rcu_gc_reclaim(unsigned long wtidx, void *old)
 {
+	if (free_rcu_reclaim) {
+		if (old)
+			free_rcu((struct test_array *) old, rcu);
+		return;
+	}
+
 	/* Queue pointer */
 	*pending_reclaims[wtidx].head = old;
 	pending_reclaims[wtidx].head++;
@@ -267,7 +317,10 @@ static void rcu_gc_reclaim(unsigned long wtidx, void *old)
 			< reclaim_batch))
 		return;
 
-	rcu_gc_clear_queue(wtidx);
+	if (polled_reclaim)
+		rcu_gc_poll_queue(wtidx);
+	else
+		rcu_gc_clear_queue(wtidx);
 }
 
 void *thr_writer(void *data)
@@ -285,6 +338,10 @@ void *thr_writer(void *data)
 
 	set_affinity();
 
+	/* start_poll_synchronize_rcu() and free_rcu() use call_rcu() */
+	if (polled_reclaim || free_rcu_reclaim)
+		rcu_register_thread();
+
 	while (!test_go)
 	{
 	}
@@ -306,6 +363,9 @@ void *thr_writer(void *data)
 			loop_sleep(wdelay);
 	}
 
+	if (polled_reclaim || free_rcu_reclaim)
+		rcu_unregister_thread();
+
 	printf_verbose("thread_end %s, thread id : %lx, tid %lu\n",
 			"writer", (unsigned long) pthread_self(),
 			(unsigned long) gettid());
@@ -322,6 +382,9 @@ void show_usage(int argc, char **argv)
 	printf(" [-d delay] (writer period (us))");
 	printf(" [-c duration] (reader C.S. duration (in loops))");
 	printf(" [-e duration] (writer C.S. duration (in loops))");
+	printf(" [-b batch] (batch reclaim)");
+	printf(" [-p] (polled grace periods for batch reclaim)");
+	printf(" [-f] (reclaim with free_rcu())");
 	printf(" [-v] (verbose output)");
 	printf(" [-a cpu#] [-a cpu#]... (affinity)");
 	printf("\n");
@@ -409,6 +472,12 @@ int main(int argc, char **argv)
 			}
 			wduration = atol(argv[++i]);
 			break;
+		case 'p':
+			polled_reclaim = 1;
+			break;
+		case 'f':
+			free_rcu_reclaim = 1;
+			break;
 		case 'v':
 			verbose_mode = 1;
 			break;
@@ -438,6 +507,15 @@ int main(int argc, char **argv)
 					sizeof(*pending_reclaims[i].queue));
 	for (i = 0; i < nr_writers; i++)
 		pending_reclaims[i].head = pending_reclaims[i].queue;
+	if (polled_reclaim) {
+		for (i = 0; i < nr_writers; i++) {
+			pending_reclaims[i].waiting = calloc(
+				caa_max(reclaim_batch, CAA_CACHE_LINE_SIZE),
+				sizeof(*pending_reclaims[i].waiting));
+			pending_reclaims[i].waiting_head =
+				pending_reclaims[i].waiting;
+		}
+	}
 
 	next_aff = 0;
 
@@ -489,8 +567,11 @@ int main(int argc, char **argv)
 	free(tid_writer);
 	free(count_reader);
 	free(tot_nr_writes);
-	for (i = 0; i < nr_writers; i++)
+	for (i = 0; i < nr_writers; i++) {
 		free(pending_reclaims[i].queue);
+		if (polled_reclaim)
+			free(pending_reclaims[i].waiting);
+	}
 	free(pending_reclaims);
 
 	return 0;
@@ -106,6 +106,7 @@ unsigned long min_hash_alloc_size = DEFAULT_MIN_ALLOC_SIZE;
 unsigned long max_hash_buckets_size = (1UL << 20);
 unsigned long init_populate;
 int opt_auto_resize;
+int opt_fingerprint;
 int add_only, add_unique, add_replace;
 const struct cds_lfht_mm_type *memory_backend;
 
@@ -114,6 +115,7 @@ unsigned long init_pool_size = DEFAULT_RAND_POOL,
 	lookup_pool_size = DEFAULT_RAND_POOL,
 	write_pool_size = DEFAULT_RAND_POOL;
 int validate_lookup;
+unsigned long lookup_batch = 1;
 unsigned long nr_hash_chains;	/* 0: normal table, other: number of hash chains */
 
 int count_pipe[2];
@@ -284,6 +286,7 @@ printf("        [not -u nor -s] Add entries (supports redundant keys).\n");
 	printf("        [-i] Add only (no removal).\n");
 	printf("        [-k nr_nodes] Number of nodes to insert initially.\n");
 	printf("        [-A] Automatically resize hash table.\n");
+	printf("        [-F] Index node hash fingerprints.\n");
 	printf("        [-B order|chunk|mmap] Specify the memory backend.\n");
 	printf("        [-R offset] Lookup pool offset.\n");
 	printf("        [-S offset] Write pool offset.\n");
@@ -292,6 +295,8 @@ printf("        [not -u nor -s] Add entries (supports redundant keys).\n");
 	printf("        [-N size] Write pool size.\n");
 	printf("        [-O size] Init pool size.\n");
 	printf("        [-V] Validate lookups of init values (use with filled init pool, same lookup range, with different write range).\n");
+	printf("        [-L batch] Lookup keys in batches of batch keys (max %d).\n",
+		MAX_LOOKUP_BATCH);
 	printf("	[-U] Uniqueness test.\n");
 	printf("	[-C] Number of hash chains.\n");
 	printf("\n\n");
@@ -430,6 +435,9 @@ int main(int argc, char **argv)
 		case 'A':
 			opt_auto_resize = 1;
 			break;
+		case 'F':
+			opt_fingerprint = 1;
+			break;
 		case 'B':
 			if (argc < i + 2) {
 				show_usage(argc, argv);
@@ -476,6 +484,20 @@ int main(int argc, char **argv)
 		case 'C':
 			nr_hash_chains = atol(argv[++i]);
 			break;
+		case 'L':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				mainret = 1;
+				goto end;
+			}
+			lookup_batch = atol(argv[++i]);
+			if (!lookup_batch || lookup_batch > MAX_LOOKUP_BATCH) {
+				printf("Lookup batch must be between 1 and %d.\n",
+					MAX_LOOKUP_BATCH);
+				mainret = 1;
+				goto end;
+			}
+			break;
 		}
 	}
 
@@ -578,12 +600,14 @@ int main(int argc, char **argv)
 		test_ht = _cds_lfht_new(init_hash_size, min_hash_alloc_size,
 				max_hash_buckets_size,
 				(opt_auto_resize ? CDS_LFHT_AUTO_RESIZE : 0) |
+				(opt_fingerprint ? CDS_LFHT_FINGERPRINT : 0) |
 				CDS_LFHT_ACCOUNTING, memory_backend,
 				&rcu_flavor, NULL);
 	} else {
 		test_ht = cds_lfht_new(init_hash_size, min_hash_alloc_size,
 				max_hash_buckets_size,
 				(opt_auto_resize ? CDS_LFHT_AUTO_RESIZE : 0) |
+				(opt_fingerprint ? CDS_LFHT_FINGERPRINT : 0) |
 				CDS_LFHT_ACCOUNTING, NULL);
 	}
 	if (!test_ht) {
@@ -162,6 +162,7 @@ extern unsigned long min_hash_alloc_size;
 extern unsigned long max_hash_buckets_size;
 extern unsigned long init_populate;
 extern int opt_auto_resize;
+extern int opt_fingerprint;
 extern int add_only, add_unique, add_replace;
 extern const struct cds_lfht_mm_type *memory_backend;
 
@@ -170,6 +171,7 @@ extern unsigned long init_pool_size,
 	lookup_pool_size,
 	write_pool_size;
 extern int validate_lookup;
+extern unsigned long lookup_batch;
 
 extern unsigned long nr_hash_chains;
 
@@ -400,6 +402,23 @@ void cds_lfht_test_lookup(struct cds_lfht *ht, void *key, size_t key_len,
 			test_match, key, iter);
 }
 
+#define MAX_LOOKUP_BATCH	64
+
+static inline
+void cds_lfht_test_lookup_batch(struct cds_lfht *ht, unsigned long n,
+		void **keys, struct cds_lfht_iter *iters)
+{
+	unsigned long hashes[MAX_LOOKUP_BATCH];
+	unsigned long i;
+
+	assert(n <= MAX_LOOKUP_BATCH);
+	for (i = 0; i < n; i++)
+		hashes[i] = test_hash(keys[i], sizeof(unsigned long),
+				TEST_HASH_SEED);
+	cds_lfht_lookup_batch(ht, n, hashes, test_match,
+			(const void * const *) keys, iters);
+}
+
 void free_node_cb(struct rcu_head *head);
 
 /* rw test */
@@ -0,0 +1,200 @@
+/*
+ * test_urcu_hash_key.c
+ *
+ * Userspace RCU library - hash table fixed-size key test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define _LGPL_SOURCE
+#include <urcu-qsbr.h>
+#include <urcu/rculfhash.h>
+
+#define NR_KEYS		10000
+#define NR_BUCKETS	(1 << 14)
+#define NR_LOOKUPS	2000000
+
+static unsigned long hash_u64(uint64_t key)
+{
+	key *= 0x9E3779B97F4A7C15ULL;
+	return (unsigned long) (key ^ (key >> 32));
+}
+
+static int match_u64(struct cds_lfht_node *node, const void *key)
+{
+	struct cds_lfht_node_u64 *knode =
+		caa_container_of(node, struct cds_lfht_node_u64, node);
+
+	return knode->key == *(const uint64_t *) key;
+}
+
+static void check(int cond, const char *msg)
+{
+	if (!cond) {
+		fprintf(stderr, "[ERROR] %s\n", msg);
+		exit(1);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the time per lookup in ns, generic or specialized. */
+static double bench_lookup(struct cds_lfht *ht, int specialized)
+{
+	struct cds_lfht_iter iter;
+	unsigned long i, found = 0;
+	uint64_t key;
+	double start;
+
+	start = now();
+	for (i = 0; i < NR_LOOKUPS; i++) {
+		/* Half of the lookups miss. */
+		key = (i * 7919) % (2 * NR_KEYS);
+		if (specialized)
+			cds_lfht_lookup_u64(ht, hash_u64(key), key, &iter);
+		else
+			cds_lfht_lookup(ht, hash_u64(key), match_u64, &key,
+				&iter);
+		if (cds_lfht_iter_get_node(&iter))
+			found++;
+	}
+	check(found == NR_LOOKUPS / 2, "unexpected lookup results");
+	return (now() - start) * 1e9 / NR_LOOKUPS;
+}
+
+static void test_u64(void)
+{
+	struct cds_lfht *ht;
+	struct cds_lfht_node_u64 *nodes, dup, extra[2], *knode;
+	struct cds_lfht_node *ret;
+	struct cds_lfht_iter iter;
+	unsigned long i;
+
+	ht = cds_lfht_new(NR_BUCKETS, 1, 0, 0, NULL);
+	check(ht != NULL, "cds_lfht_new failed");
+	nodes = calloc(NR_KEYS, sizeof(*nodes));
+	check(nodes != NULL, "out of memory");
+	for (i = 0; i < NR_KEYS; i++) {
+		/* Even keys only, odd keys miss. */
+		nodes[i].key = 2 * i;
+		cds_lfht_node_init(&nodes[i].node);
+		ret = cds_lfht_add_unique_u64(ht, hash_u64(nodes[i].key),
+				&nodes[i]);
+		check(ret == &nodes[i].node, "add_unique of a new key failed");
+	}
+	dup.key = 42;
+	ret = cds_lfht_add_unique_u64(ht, hash_u64(dup.key), &dup);
+	check(ret == &nodes[21].node, "add_unique added a duplicate key");
+
+	/* Mixing with the generic functions. */
+	cds_lfht_lookup(ht, hash_u64(dup.key), match_u64, &dup.key, &iter);
+	check(cds_lfht_iter_get_node(&iter) == &nodes[21].node,
+		"generic lookup missed");
+
+	/* Replace and delete a key out of the lookup range. */
+	extra[0].key = extra[1].key = 2 * NR_KEYS;
+	ret = cds_lfht_add_replace_u64(ht, hash_u64(2 * NR_KEYS), &extra[0]);
+	check(ret == NULL, "add_replace of a new key replaced a node");
+	ret = cds_lfht_add_replace_u64(ht, hash_u64(2 * NR_KEYS), &extra[1]);
+	check(ret == &extra[0].node, "add_replace did not replace");
+	cds_lfht_lookup_u64(ht, hash_u64(2 * NR_KEYS), 2 * NR_KEYS, &iter);
+	check(cds_lfht_iter_get_node(&iter) == &extra[1].node,
+		"lookup did not find the replacement");
+	check(!cds_lfht_del(ht, cds_lfht_iter_get_node(&iter)), "del failed");
+	cds_lfht_lookup_u64(ht, hash_u64(2 * NR_KEYS), 2 * NR_KEYS, &iter);
+	check(!cds_lfht_iter_get_node(&iter), "lookup found a deleted key");
+
+	for (i = 0; i < NR_KEYS; i++) {
+		cds_lfht_lookup_u64(ht, hash_u64(2 * i), 2 * i, &iter);
+		check(cds_lfht_iter_get_node(&iter) == &nodes[i].node,
+			"lookup missed a key");
+		knode = caa_container_of(cds_lfht_iter_get_node(&iter),
+				struct cds_lfht_node_u64, node);
+		check(knode->key == 2 * i, "lookup found a wrong key");
+	}
+
+	printf("u64: generic lookup %.1f ns, ", bench_lookup(ht, 0));
+	printf("specialized lookup %.1f ns\n", bench_lookup(ht, 1));
+
+	for (i = 0; i < NR_KEYS; i++)
+		check(!cds_lfht_del(ht, &nodes[i].node), "del failed");
+	check(!cds_lfht_destroy(ht, NULL), "cds_lfht_destroy failed");
+	synchronize_rcu();
+	free(nodes);
+}
+
+static void test_u32_u128(void)
+{
+	struct cds_lfht *ht32, *ht128;
+	struct cds_lfht_node_u32 n32[2];
+	struct cds_lfht_node_u128 n128[2];
+	struct cds_lfht_key_u128 key128;
+	struct cds_lfht_iter iter;
+	int i;
+
+	ht32 = cds_lfht_new(1, 1, 0, 0, NULL);
+	ht128 = cds_lfht_new(1, 1, 0, 0, NULL);
+	check(ht32 && ht128, "cds_lfht_new failed");
+	/* Same hash, so that keys are compared. */
+	for (i = 0; i < 2; i++) {
+		n32[i].key = i;
+		check(cds_lfht_add_unique_u32(ht32, 0, &n32[i]) == &n32[i].node,
+			"u32 add_unique failed");
+		/* Keys differing only in their high half. */
+		n128[i].key.lo = 1;
+		n128[i].key.hi = i;
+		check(cds_lfht_add_unique_u128(ht128, 0, &n128[i])
+				== &n128[i].node,
+			"u128 add_unique failed");
+	}
+	for (i = 0; i < 2; i++) {
+		cds_lfht_lookup_u32(ht32, 0, i, &iter);
+		check(cds_lfht_iter_get_node(&iter) == &n32[i].node,
+			"u32 lookup failed");
+		cds_lfht_lookup_u128(ht128, 0, n128[i].key, &iter);
+		check(cds_lfht_iter_get_node(&iter) == &n128[i].node,
+			"u128 lookup failed");
+	}
+	key128.lo = 0;
+	key128.hi = 1;
+	cds_lfht_lookup_u128(ht128, 0, key128, &iter);
+	check(!cds_lfht_iter_get_node(&iter), "u128 lookup found a wrong key");
+	for (i = 0; i < 2; i++) {
+		check(!cds_lfht_del(ht32, &n32[i].node), "del failed");
+		check(!cds_lfht_del(ht128, &n128[i].node), "del failed");
+	}
+	check(!cds_lfht_destroy(ht32, NULL) && !cds_lfht_destroy(ht128, NULL),
+		"cds_lfht_destroy failed");
+	printf("u32, u128: OK\n");
+}
+
+int main(int argc, char **argv)
+{
+	rcu_register_thread();
+	test_u64();
+	test_u32_u128();
+	rcu_unregister_thread();
+	return 0;
+}
@@ -59,11 +59,39 @@ void test_hash_rw_sigusr2_handler(int signo)
 	} while (ret == -1L && errno == EINTR);
 }
 
+static
+void test_hash_rw_lookup(void)
+{
+	void *keys[MAX_LOOKUP_BATCH];
+	struct cds_lfht_iter iters[MAX_LOOKUP_BATCH];
+	struct lfht_test_node *node;
+	unsigned long i;
+
+	for (i = 0; i < lookup_batch; i++)
+		keys[i] = (void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % lookup_pool_size) + lookup_pool_offset);
+	if (lookup_batch == 1)
+		cds_lfht_test_lookup(test_ht, keys[0], sizeof(void *),
+			&iters[0]);
+	else
+		cds_lfht_test_lookup_batch(test_ht, lookup_batch, keys, iters);
+	for (i = 0; i < lookup_batch; i++) {
+		node = cds_lfht_iter_get_test_node(&iters[i]);
+		if (node == NULL) {
+			if (validate_lookup) {
+				printf("[ERROR] Lookup cannot find initial node.\n");
+				exit(-1);
+			}
+			URCU_TLS(lookup_fail)++;
+		} else {
+			assert(node->key == keys[i]);
+			URCU_TLS(lookup_ok)++;
+		}
+	}
+}
+
 void *test_hash_rw_thr_reader(void *_count)
 {
 	unsigned long long *count = _count;
-	struct lfht_test_node *node;
-	struct cds_lfht_iter iter;
 
 	printf_verbose("thread_begin %s, thread id : %lx, tid %lu\n",
 			"reader", (unsigned long) pthread_self(),
@@ -80,27 +108,17 @@ void *test_hash_rw_thr_reader(void *_count)
 
 	for (;;) {
 		rcu_read_lock();
-		cds_lfht_test_lookup(test_ht,
-			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % lookup_pool_size) + lookup_pool_offset),
-			sizeof(void *), &iter);
-		node = cds_lfht_iter_get_test_node(&iter);
-		if (node == NULL) {
-			if (validate_lookup) {
-				printf("[ERROR] Lookup cannot find initial node.\n");
-				exit(-1);
-			}
-			URCU_TLS(lookup_fail)++;
-		} else {
-			URCU_TLS(lookup_ok)++;
-		}
+		test_hash_rw_lookup();
 		rcu_debug_yield_read();
 		if (caa_unlikely(rduration))
 			loop_sleep(rduration);
 		rcu_read_unlock();
-		URCU_TLS(nr_reads)++;
+		URCU_TLS(nr_reads) += lookup_batch;
 		if (caa_unlikely(!test_duration_read()))
 			break;
-		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 10) - 1)) == 0))
+		/* Every 1024 reads, whatever the batch size. */
+		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 10) - 1))
+				< lookup_batch))
 			rcu_quiescent_state();
 	}
 
@@ -0,0 +1,215 @@
+/*
+ * test_urcu_lfoht.c
+ *
+ * Userspace RCU library - open-addressing hash table test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+
+#define _LGPL_SOURCE
+#include <urcu.h>
+#include <urcu/rculfoht.h>
+
+#define NR_READERS	2
+#define NR_WRITERS	4
+#define NR_OPS		200000
+/* Keys shared by writers, added and removed at random. */
+#define NR_KEYS		4096
+/* Keys added before the writers start, never removed. */
+#define NR_STABLE	1024
+#define STABLE_BASE	(1ULL << 40)
+#define NR_LOOKUPS	(2 * NR_STABLE * 1000)
+
+static struct cds_lfoht *ht;
+static long balance[NR_KEYS + 1];
+static int test_stop;
+
+static void check(int cond, const char *msg)
+{
+	if (!cond) {
+		fprintf(stderr, "[ERROR] %s\n", msg);
+		exit(1);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void test_api(void)
+{
+	uint64_t value;
+
+	rcu_read_lock();
+	check(cds_lfoht_add(ht, 0, 1) == -EINVAL, "add of key 0 accepted");
+	check(cds_lfoht_add(ht, UINT64_MAX, 1) == -EINVAL,
+		"add of key UINT64_MAX accepted");
+	check(cds_lfoht_add(ht, 1, CDS_LFOHT_VALUE_MAX + 1) == -EINVAL,
+		"add of a reserved value accepted");
+	check(!cds_lfoht_add(ht, 1, CDS_LFOHT_VALUE_MAX), "add failed");
+	check(cds_lfoht_add(ht, 1, 2) == -EEXIST, "add of a duplicate key");
+	check(!cds_lfoht_lookup(ht, 1, &value)
+		&& value == CDS_LFOHT_VALUE_MAX, "lookup failed");
+	check(!cds_lfoht_del(ht, 1), "del failed");
+	check(cds_lfoht_del(ht, 1) == -ENOENT, "del of a deleted key");
+	check(cds_lfoht_lookup(ht, 1, &value) == -ENOENT,
+		"lookup found a deleted key");
+	rcu_read_unlock();
+}
+
+/* Stable keys must be found through all resizes. */
+static void *thr_reader(void *arg)
+{
+	unsigned long i = 0;
+	uint64_t value;
+	int ret;
+
+	rcu_register_thread();
+	while (!CMM_LOAD_SHARED(test_stop)) {
+		rcu_read_lock();
+		ret = cds_lfoht_lookup(ht, STABLE_BASE + i, &value);
+		rcu_read_unlock();
+		check(!ret && value == i, "lookup of a stable key failed");
+		i = (i + 1) % NR_STABLE;
+	}
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/* The value of a shared key is always twice the key. */
+static void *thr_writer(void *arg)
+{
+	unsigned int seed = (unsigned long) arg;
+	unsigned long i;
+	uint64_t key, value;
+	int ret;
+
+	rcu_register_thread();
+	for (i = 0; i < NR_OPS; i++) {
+		key = rand_r(&seed) % NR_KEYS + 1;
+		rcu_read_lock();
+		switch (rand_r(&seed) % 3) {
+		case 0:
+			ret = cds_lfoht_add(ht, key, 2 * key);
+			check(!ret || ret == -EEXIST, "add failed");
+			if (!ret)
+				uatomic_inc(&balance[key]);
+			break;
+		case 1:
+			ret = cds_lfoht_del(ht, key);
+			check(!ret || ret == -ENOENT, "del failed");
+			if (!ret)
+				uatomic_dec(&balance[key]);
+			break;
+		default:
+			ret = cds_lfoht_lookup(ht, key, &value);
+			check(ret == -ENOENT || (!ret && value == 2 * key),
+				"lookup found a wrong value");
+		}
+		rcu_read_unlock();
+	}
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static void test_concurrent(void)
+{
+	pthread_t readers[NR_READERS], writers[NR_WRITERS];
+	unsigned long i;
+	uint64_t value;
+	int err, ret;
+
+	rcu_read_lock();
+	for (i = 0; i < NR_STABLE; i++)
+		check(!cds_lfoht_add(ht, STABLE_BASE + i, i), "add failed");
+	rcu_read_unlock();
+	for (i = 0; i < NR_READERS; i++) {
+		err = pthread_create(&readers[i], NULL, thr_reader, NULL);
+		check(!err, "pthread_create failed");
+	}
+	for (i = 0; i < NR_WRITERS; i++) {
+		err = pthread_create(&writers[i], NULL, thr_writer,
+				(void *) (i + 1));
+		check(!err, "pthread_create failed");
+	}
+	for (i = 0; i < NR_WRITERS; i++) {
+		err = pthread_join(writers[i], NULL);
+		check(!err, "pthread_join failed");
+	}
+	CMM_STORE_SHARED(test_stop, 1);
+	for (i = 0; i < NR_READERS; i++) {
+		err = pthread_join(readers[i], NULL);
+		check(!err, "pthread_join failed");
+	}
+
+	rcu_read_lock();
+	for (i = 1; i <= NR_KEYS; i++) {
+		ret = cds_lfoht_lookup(ht, i, &value);
+		check(balance[i] == 0 || balance[i] == 1,
+			"key added or removed twice");
+		check(balance[i] ? !ret && value == 2 * i : ret == -ENOENT,
+			"lookup does not match additions and removals");
+	}
+	rcu_read_unlock();
+	printf("concurrent: OK\n");
+}
+
+static void bench_lookup(void)
+{
+	unsigned long i, found = 0;
+	uint64_t value;
+	double start;
+
+	start = now();
+	rcu_read_lock();
+	for (i = 0; i < NR_LOOKUPS; i++) {
+		/* Half of the lookups miss. */
+		if (!cds_lfoht_lookup(ht, STABLE_BASE + i % (2 * NR_STABLE),
+				&value))
+			found++;
+	}
+	rcu_read_unlock();
+	check(found == NR_LOOKUPS / 2, "unexpected lookup results");
+	printf("lookup %.1f ns\n", (now() - start) * 1e9 / NR_LOOKUPS);
+}
+
+int main(int argc, char **argv)
+{
+	rcu_register_thread();
+	/* Start small, so that the writers resize the table repeatedly. */
+	ht = cds_lfoht_new(8);
+	check(ht != NULL, "cds_lfoht_new failed");
+	check(cds_lfoht_new(3) == NULL, "cds_lfoht_new accepted size 3");
+	test_api();
+	test_concurrent();
+	bench_lookup();
+	check(!cds_lfoht_destroy(ht), "cds_lfoht_destroy failed");
+	rcu_unregister_thread();
+	rcu_barrier();
+	return 0;
+}
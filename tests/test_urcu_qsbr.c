@@ -84,6 +84,9 @@ static unsigned long rduration;
 /* write-side C.S. duration, in loops */
 static unsigned long wduration;
 
+/* Grace periods are performed by the grace period driver thread. */
+static int gp_driver;
+
 static inline void loop_sleep(unsigned long loops)
 {
 	while (loops-- != 0)
@@ -309,6 +312,29 @@ void *thr_writer(void *_count)
 	return ((void*)2);
 }
 
+/*
+ * Every write waits for a grace period, possibly shared with other
+ * writers.
+ */
+static void check_gp_stats(unsigned long long tot_writes)
+{
+	struct rcu_gp_stats stats;
+	unsigned long hist_sum = 0;
+	int i;
+
+	rcu_get_gp_stats(&stats);
+	for (i = 0; i < RCU_GP_STATS_HIST_LEN; i++)
+		hist_sum += stats.duration_hist[i];
+	printf_verbose("grace periods %lu, scans %lu (max %lu), "
+		"futex waits %lu, mb master %lu\n",
+		stats.nr_gp, stats.nr_scans, stats.max_scans,
+		stats.nr_futex_wait, stats.nr_mb_master);
+	if (hist_sum != stats.nr_gp || (tot_writes && !stats.nr_gp)) {
+		fprintf(stderr, "Inconsistent grace period statistics\n");
+		exit(1);
+	}
+}
+
 void show_usage(int argc, char **argv)
 {
 	printf("Usage : %s nr_readers nr_writers duration (s)", argv[0]);
@@ -318,6 +344,7 @@ void show_usage(int argc, char **argv)
 	printf(" [-d delay] (writer period (us))");
 	printf(" [-c duration] (reader C.S. duration (in loops))");
 	printf(" [-e duration] (writer C.S. duration (in loops))");
+	printf(" [-g] (grace period driver thread)");
 	printf(" [-v] (verbose output)");
 	printf(" [-a cpu#] [-a cpu#]... (affinity)");
 	printf("\n");
@@ -398,6 +425,9 @@ int main(int argc, char **argv)
 			}
 			wduration = atol(argv[++i]);
 			break;
+		case 'g':
+			gp_driver = 1;
+			break;
 		case 'v':
 			verbose_mode = 1;
 			break;
@@ -408,6 +438,8 @@ int main(int argc, char **argv)
 		duration, nr_readers, nr_writers);
 	printf_verbose("Writer delay : %lu loops.\n", wdelay);
 	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Grace period driver : %s.\n",
+			gp_driver ? "enabled" : "disabled");
 	printf_verbose("thread %-6s, thread id : %lx, tid %lu\n",
 			"main", (unsigned long) pthread_self(),
 			(unsigned long) gettid());
@@ -433,6 +465,9 @@ int main(int argc, char **argv)
 			exit(1);
 	}
 
+	if (gp_driver)
+		rcu_gp_driver_start();
+
 	cmm_smp_mb();
 
 	test_go = 1;
@@ -453,9 +488,11 @@ int main(int argc, char **argv)
 			exit(1);
 		tot_writes += count_writer[i];
 	}
+	rcu_gp_driver_stop();
 	
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
+	check_gp_stats(tot_writes);
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
@@ -0,0 +1,165 @@
+/*
+ * test_urcu_register.c
+ *
+ * Userspace RCU library - registration during a grace period test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+
+#define _LGPL_SOURCE
+#if defined(RCU_QSBR)
+#include <urcu-qsbr.h>
+#elif defined(RCU_BP)
+#include <urcu-bp.h>
+#else
+#include <urcu.h>
+#endif
+
+/*
+ * Reader critical section length, which the grace period waits for,
+ * and longest registration time accepted, in ms.
+ */
+#define STALL_MS	500
+#define REGISTER_MS	100
+
+/* Short-lived reader threads, to exercise registry entry reuse. */
+#define NR_CHURN	256
+#define CHURN_BATCH	64
+
+static int reader_ready, gp_started;
+static int *test_ptr;
+
+static unsigned long now_ms(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+static void *thr_stall_reader(void *arg)
+{
+	rcu_register_thread();
+	rcu_read_lock();
+	uatomic_set(&reader_ready, 1);
+	poll(NULL, 0, STALL_MS);
+	rcu_read_unlock();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static void *thr_updater(void *arg)
+{
+	int *old;
+
+	old = rcu_xchg_pointer(&test_ptr, NULL);
+	uatomic_set(&gp_started, 1);
+	synchronize_rcu();
+	free(old);
+	return NULL;
+}
+
+/*
+ * Registers while the grace period waits for the stalled reader, then
+ * reads the pointer the grace period is about to free.
+ */
+static void *thr_new_reader(void *arg)
+{
+	unsigned long *register_ms = arg;
+	unsigned long start;
+	int *p;
+
+	/* urcu-bp registers the thread in its first rcu_read_lock(). */
+	start = now_ms();
+	rcu_register_thread();
+	rcu_read_lock();
+	if (register_ms)
+		*register_ms = now_ms() - start;
+	p = rcu_dereference(test_ptr);
+	if (p && *p != 42)
+		abort();
+	rcu_read_unlock();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t stall_tid, updater_tid, new_tid;
+	pthread_t churn_tid[CHURN_BATCH];
+	unsigned long register_ms;
+	int err, i, j;
+
+	test_ptr = malloc(sizeof(*test_ptr));
+	*test_ptr = 42;
+
+	err = pthread_create(&stall_tid, NULL, thr_stall_reader, NULL);
+	if (err != 0)
+		exit(1);
+	while (!uatomic_read(&reader_ready))
+		poll(NULL, 0, 1);
+	err = pthread_create(&updater_tid, NULL, thr_updater, NULL);
+	if (err != 0)
+		exit(1);
+	while (!uatomic_read(&gp_started))
+		poll(NULL, 0, 1);
+	/* Let the grace period start waiting for the stalled reader. */
+	poll(NULL, 0, STALL_MS / 5);
+
+	err = pthread_create(&new_tid, NULL, thr_new_reader, &register_ms);
+	if (err != 0)
+		exit(1);
+	err = pthread_join(new_tid, NULL);
+	if (err != 0)
+		exit(1);
+	err = pthread_join(updater_tid, NULL);
+	if (err != 0)
+		exit(1);
+	err = pthread_join(stall_tid, NULL);
+	if (err != 0)
+		exit(1);
+
+	for (i = 0; i < NR_CHURN; i += CHURN_BATCH) {
+		for (j = 0; j < CHURN_BATCH; j++) {
+			err = pthread_create(&churn_tid[j], NULL,
+					thr_new_reader, NULL);
+			if (err != 0)
+				exit(1);
+		}
+		for (j = 0; j < CHURN_BATCH; j++) {
+			err = pthread_join(churn_tid[j], NULL);
+			if (err != 0)
+				exit(1);
+		}
+	}
+	synchronize_rcu();
+
+	printf("Registration took %lu ms during a %d ms grace period\n",
+		register_ms, STALL_MS);
+	if (register_ms > REGISTER_MS) {
+		fprintf(stderr, "Registration waited for the grace period\n");
+		exit(1);
+	}
+	return 0;
+}
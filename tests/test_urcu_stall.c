@@ -0,0 +1,105 @@
+/*
+ * test_urcu_stall.c
+ *
+ * Userspace RCU library - reader stall detector test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+
+#define _LGPL_SOURCE
+#ifdef RCU_QSBR
+#include <urcu-qsbr.h>
+#else
+#include <urcu.h>
+#endif
+
+/* Reader critical section length, and stall detection timeout, in ms. */
+#define STALL_MS	300
+#define TIMEOUT_MS	50
+
+static int reader_ready;
+static pthread_t reported_tid;
+static unsigned long nr_reports, reported_ms;
+
+static void report(pthread_t tid, unsigned long stall_ms, void *priv)
+{
+	unsigned long *count = priv;
+
+	reported_tid = tid;
+	reported_ms = stall_ms;
+	(*count)++;
+}
+
+/*
+ * For QSBR, the reader stays online without reporting quiescent
+ * states: rcu_read_lock() itself is a no-op.
+ */
+static void *thr_reader(void *arg)
+{
+	rcu_register_thread();
+	rcu_read_lock();
+	uatomic_set(&reader_ready, 1);
+	poll(NULL, 0, STALL_MS);
+	rcu_read_unlock();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct rcu_gp_stats stats;
+	pthread_t tid;
+	int err;
+
+	rcu_set_stall_detector(TIMEOUT_MS, report, &nr_reports);
+
+	err = pthread_create(&tid, NULL, thr_reader, NULL);
+	if (err != 0)
+		exit(1);
+	while (!uatomic_read(&reader_ready))
+		poll(NULL, 0, 1);
+	synchronize_rcu();
+	err = pthread_join(tid, NULL);
+	if (err != 0)
+		exit(1);
+
+	rcu_get_gp_stats(&stats);
+	printf("%lu stall reports, last after %lu ms\n", nr_reports,
+		reported_ms);
+	if (!nr_reports || !pthread_equal(reported_tid, tid)
+			|| reported_ms < TIMEOUT_MS
+			|| stats.nr_stalls != nr_reports) {
+		fprintf(stderr, "Stalled reader not reported\n");
+		exit(1);
+	}
+
+	/* Grace periods without readers must not report anything. */
+	rcu_set_stall_detector(0, NULL, NULL);
+	synchronize_rcu();
+	rcu_get_gp_stats(&stats);
+	if (stats.nr_stalls != nr_reports) {
+		fprintf(stderr, "Unexpected stall report\n");
+		exit(1);
+	}
+	return 0;
+}
@@ -99,6 +99,7 @@ static int num_write;
 
 static cycles_t __attribute__((aligned(CAA_CACHE_LINE_SIZE))) *reader_time;
 static cycles_t __attribute__((aligned(CAA_CACHE_LINE_SIZE))) *writer_time;
+static cycles_t __attribute__((aligned(CAA_CACHE_LINE_SIZE))) *writer_exp_time;
 
 void *thr_reader(void *arg)
 {
@@ -138,12 +139,42 @@ void *thr_reader(void *arg)
 
 }
 
-void *thr_writer(void *arg)
+static cycles_t do_write(int expedited)
 {
-	int i, j;
 	struct test_array *new, *old;
 	cycles_t time1, time2;
 
+	time1 = caa_get_cycles();
+	new = malloc(sizeof(struct test_array));
+	rcu_copy_mutex_lock();
+	old = test_rcu_pointer;
+	if (old) {
+		assert(old->a == 8);
+	}
+	new->a = 8;
+	old = rcu_xchg_pointer(&test_rcu_pointer, new);
+	rcu_copy_mutex_unlock();
+	if (expedited)
+		synchronize_rcu_expedited();
+	else
+		synchronize_rcu();
+	/* can be done after unlock */
+	if (old) {
+		old->a = 0;
+	}
+	free(old);
+	time2 = caa_get_cycles();
+	return time2 - time1;
+}
+
+/*
+ * Alternate normal and expedited grace periods, so both are measured
+ * against the same reader load.
+ */
+void *thr_writer(void *arg)
+{
+	int i, j;
+
 	printf("thread_begin %s, thread id : %lx, tid %lu\n",
 			"writer", (unsigned long) pthread_self(),
 			(unsigned long) gettid());
@@ -151,24 +182,9 @@ void *thr_writer(void *arg)
 
 	for (i = 0; i < OUTER_WRITE_LOOP; i++) {
 		for (j = 0; j < INNER_WRITE_LOOP; j++) {
-			time1 = caa_get_cycles();
-			new = malloc(sizeof(struct test_array));
-			rcu_copy_mutex_lock();
-			old = test_rcu_pointer;
-			if (old) {
-				assert(old->a == 8);
-			}
-			new->a = 8;
-			old = rcu_xchg_pointer(&test_rcu_pointer, new);
-			rcu_copy_mutex_unlock();
-			synchronize_rcu();
-			/* can be done after unlock */
-			if (old) {
-				old->a = 0;
-			}
-			free(old);
-			time2 = caa_get_cycles();
-			writer_time[(unsigned long)arg] += time2 - time1;
+			writer_time[(unsigned long)arg] += do_write(0);
+			usleep(1);
+			writer_exp_time[(unsigned long)arg] += do_write(1);
 			usleep(1);
 		}
 	}
@@ -187,6 +203,7 @@ int main(int argc, char **argv)
 	int i;
 	cycles_t tot_rtime = 0;
 	cycles_t tot_wtime = 0;
+	cycles_t tot_wexptime = 0;
 
 	if (argc < 2) {
 		printf("Usage : %s nr_readers nr_writers\n", argv[0]);
@@ -196,7 +213,8 @@ int main(int argc, char **argv)
 	num_write = atoi(argv[2]);
 
 	reader_time = malloc(sizeof(*reader_time) * num_read);
-	writer_time = malloc(sizeof(*writer_time) * num_write);
+	writer_time = calloc(num_write, sizeof(*writer_time));
+	writer_exp_time = calloc(num_write, sizeof(*writer_exp_time));
 	tid_reader = malloc(sizeof(*tid_reader) * num_read);
 	tid_writer = malloc(sizeof(*tid_writer) * num_write);
 
@@ -230,15 +248,19 @@ int main(int argc, char **argv)
 		if (err != 0)
 			exit(1);
 		tot_wtime += writer_time[i];
+		tot_wexptime += writer_exp_time[i];
 	}
 	free(test_rcu_pointer);
 	printf("Time per read : %g cycles\n",
 	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP));
 	printf("Time per write : %g cycles\n",
 	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP));
+	printf("Time per expedited write : %g cycles\n",
+	       (double)tot_wexptime / ((double)NR_WRITE * (double)WRITE_LOOP));
 
 	free(reader_time);
 	free(writer_time);
+	free(writer_exp_time);
 	free(tid_reader);
 	free(tid_writer);
 
@@ -0,0 +1,438 @@
+/*
+ * urcu-auto.c
+ *
+ * Userspace RCU library - runtime flavor selection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <pthread.h>
+
+#include "urcu/compiler.h"
+#include "urcu/system.h"
+
+/* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
+#include "urcu-auto.h"
+
+/*
+ * The signal flavor is not a candidate: it claims SIGRCU as soon as it
+ * is loaded, which an application linking with liburcu-auto does not
+ * expect.
+ */
+#define RCU_AUTO_DECLARE_FLAVOR(suffix)					\
+extern const struct rcu_flavor_struct rcu_flavor_##suffix;		\
+extern void rcu_init_##suffix(void);					\
+extern void synchronize_rcu_expedited_##suffix(void);			\
+extern void rcu_get_gp_stats_##suffix(struct rcu_gp_stats *stats);	\
+extern void rcu_set_stall_detector_##suffix(unsigned long timeout_ms,	\
+		void (*report)(pthread_t tid, unsigned long stall_ms,	\
+			void *priv),					\
+		void *priv);						\
+extern void rcu_gp_driver_start_##suffix(void);				\
+extern void rcu_gp_driver_stop_##suffix(void);				\
+extern struct call_rcu_data *get_cpu_call_rcu_data_##suffix(int cpu);	\
+extern pthread_t get_call_rcu_thread_##suffix(struct call_rcu_data *crdp); \
+extern struct call_rcu_data *create_call_rcu_data_##suffix(		\
+		unsigned long flags, int cpu_affinity);			\
+extern struct call_rcu_data *create_call_rcu_data_eventfd_##suffix(	\
+		unsigned long flags, int cpu_affinity);			\
+extern int get_call_rcu_eventfd_##suffix(struct call_rcu_data *crdp);	\
+extern unsigned long call_rcu_run_ready_##suffix(			\
+		struct call_rcu_data *crdp);				\
+extern int set_cpu_call_rcu_data_##suffix(int cpu,			\
+		struct call_rcu_data *crdp);				\
+extern struct call_rcu_data *get_default_call_rcu_data_##suffix(void);	\
+extern struct call_rcu_data *get_call_rcu_data_##suffix(void);		\
+extern struct call_rcu_data *get_thread_call_rcu_data_##suffix(void);	\
+extern void set_thread_call_rcu_data_##suffix(struct call_rcu_data *crdp); \
+extern int create_all_cpu_call_rcu_data_##suffix(unsigned long flags);	\
+extern void free_all_cpu_call_rcu_data_##suffix(void);			\
+extern void call_rcu_data_free_##suffix(struct call_rcu_data *crdp);	\
+extern void rcu_barrier_##suffix(void);					\
+extern void set_call_rcu_data_backlog_##suffix(struct call_rcu_data *crdp, \
+		unsigned long expedite, unsigned long limit);		\
+extern void free_rcu_head_##suffix(struct rcu_head *head,		\
+		unsigned long offset);					\
+extern void call_rcu_bulk_##suffix(struct rcu_head **heads,		\
+		unsigned long nr, void (*func)(struct rcu_head *head));	\
+extern void call_rcu_before_fork_##suffix(void);			\
+extern void call_rcu_after_fork_parent_##suffix(void);			\
+extern void call_rcu_after_fork_child_##suffix(void);			\
+extern int rcu_defer_register_thread_##suffix(void);			\
+extern void rcu_defer_unregister_thread_##suffix(void);			\
+extern void rcu_defer_barrier_##suffix(void);				\
+extern void rcu_defer_barrier_thread_##suffix(void);			\
+extern void rcu_defer_set_queue_limit_##suffix(unsigned long nr_entries); \
+extern void rcu_defer_set_batch_##suffix(unsigned long threshold,	\
+		unsigned long delay_ms);
+
+RCU_AUTO_DECLARE_FLAVOR(memb)
+RCU_AUTO_DECLARE_FLAVOR(mb)
+
+extern int rcu_has_sys_membarrier_memb;
+
+/*
+ * Entry points not covered by struct rcu_flavor_struct.
+ */
+struct rcu_auto_ops {
+	const struct rcu_flavor_struct *flavor;
+	void (*synchronize_rcu_expedited)(void);
+	void (*rcu_get_gp_stats)(struct rcu_gp_stats *stats);
+	void (*rcu_set_stall_detector)(unsigned long timeout_ms,
+			void (*report)(pthread_t tid, unsigned long stall_ms,
+				void *priv),
+			void *priv);
+	void (*rcu_gp_driver_start)(void);
+	void (*rcu_gp_driver_stop)(void);
+	struct call_rcu_data *(*get_cpu_call_rcu_data)(int cpu);
+	pthread_t (*get_call_rcu_thread)(struct call_rcu_data *crdp);
+	struct call_rcu_data *(*create_call_rcu_data)(unsigned long flags,
+			int cpu_affinity);
+	struct call_rcu_data *(*create_call_rcu_data_eventfd)(
+			unsigned long flags, int cpu_affinity);
+	int (*get_call_rcu_eventfd)(struct call_rcu_data *crdp);
+	unsigned long (*call_rcu_run_ready)(struct call_rcu_data *crdp);
+	int (*set_cpu_call_rcu_data)(int cpu, struct call_rcu_data *crdp);
+	struct call_rcu_data *(*get_default_call_rcu_data)(void);
+	struct call_rcu_data *(*get_call_rcu_data)(void);
+	struct call_rcu_data *(*get_thread_call_rcu_data)(void);
+	void (*set_thread_call_rcu_data)(struct call_rcu_data *crdp);
+	int (*create_all_cpu_call_rcu_data)(unsigned long flags);
+	void (*free_all_cpu_call_rcu_data)(void);
+	void (*call_rcu_data_free)(struct call_rcu_data *crdp);
+	void (*rcu_barrier)(void);
+	void (*set_call_rcu_data_backlog)(struct call_rcu_data *crdp,
+			unsigned long expedite, unsigned long limit);
+	void (*free_rcu_head)(struct rcu_head *head, unsigned long offset);
+	void (*call_rcu_bulk)(struct rcu_head **heads, unsigned long nr,
+			void (*func)(struct rcu_head *head));
+	void (*call_rcu_before_fork)(void);
+	void (*call_rcu_after_fork_parent)(void);
+	void (*call_rcu_after_fork_child)(void);
+	int (*rcu_defer_register_thread)(void);
+	void (*rcu_defer_unregister_thread)(void);
+	void (*rcu_defer_barrier)(void);
+	void (*rcu_defer_barrier_thread)(void);
+	void (*rcu_defer_set_queue_limit)(unsigned long nr_entries);
+	void (*rcu_defer_set_batch)(unsigned long threshold,
+		unsigned long delay_ms);
+};
+
+/*
+ * Field names are mapped by urcu/map/urcu-auto.h like the functions
+ * they are named after, consistently within this file.
+ */
+#define RCU_AUTO_OPS(suffix)						\
+{									\
+	.flavor = &rcu_flavor_##suffix,					\
+	.synchronize_rcu_expedited = synchronize_rcu_expedited_##suffix, \
+	.rcu_get_gp_stats = rcu_get_gp_stats_##suffix,			\
+	.rcu_set_stall_detector = rcu_set_stall_detector_##suffix,	\
+	.rcu_gp_driver_start = rcu_gp_driver_start_##suffix,		\
+	.rcu_gp_driver_stop = rcu_gp_driver_stop_##suffix,		\
+	.get_cpu_call_rcu_data = get_cpu_call_rcu_data_##suffix,	\
+	.get_call_rcu_thread = get_call_rcu_thread_##suffix,		\
+	.create_call_rcu_data = create_call_rcu_data_##suffix,		\
+	.create_call_rcu_data_eventfd = create_call_rcu_data_eventfd_##suffix, \
+	.get_call_rcu_eventfd = get_call_rcu_eventfd_##suffix,		\
+	.call_rcu_run_ready = call_rcu_run_ready_##suffix,		\
+	.set_cpu_call_rcu_data = set_cpu_call_rcu_data_##suffix,	\
+	.get_default_call_rcu_data = get_default_call_rcu_data_##suffix, \
+	.get_call_rcu_data = get_call_rcu_data_##suffix,		\
+	.get_thread_call_rcu_data = get_thread_call_rcu_data_##suffix,	\
+	.set_thread_call_rcu_data = set_thread_call_rcu_data_##suffix,	\
+	.create_all_cpu_call_rcu_data = create_all_cpu_call_rcu_data_##suffix, \
+	.free_all_cpu_call_rcu_data = free_all_cpu_call_rcu_data_##suffix, \
+	.call_rcu_data_free = call_rcu_data_free_##suffix,		\
+	.rcu_barrier = rcu_barrier_##suffix,				\
+	.set_call_rcu_data_backlog = set_call_rcu_data_backlog_##suffix, \
+	.free_rcu_head = free_rcu_head_##suffix,			\
+	.call_rcu_bulk = call_rcu_bulk_##suffix,			\
+	.call_rcu_before_fork = call_rcu_before_fork_##suffix,		\
+	.call_rcu_after_fork_parent = call_rcu_after_fork_parent_##suffix, \
+	.call_rcu_after_fork_child = call_rcu_after_fork_child_##suffix, \
+	.rcu_defer_register_thread = rcu_defer_register_thread_##suffix, \
+	.rcu_defer_unregister_thread = rcu_defer_unregister_thread_##suffix, \
+	.rcu_defer_barrier = rcu_defer_barrier_##suffix,		\
+	.rcu_defer_barrier_thread = rcu_defer_barrier_thread_##suffix,	\
+	.rcu_defer_set_queue_limit = rcu_defer_set_queue_limit_##suffix, \
+	.rcu_defer_set_batch = rcu_defer_set_batch_##suffix,		\
+}
+
+static const struct rcu_auto_ops rcu_auto_ops_memb = RCU_AUTO_OPS(memb);
+static const struct rcu_auto_ops rcu_auto_ops_mb = RCU_AUTO_OPS(mb);
+
+static const struct rcu_auto_ops *rcu_auto_ops;
+const struct rcu_flavor_struct *rcu_auto_flavor;
+
+void __attribute__((constructor)) rcu_init(void);
+
+/*
+ * rcu_init constructor. Called when the library is linked, but also
+ * lazily by update-side entry points in case gcc does not support the
+ * constructor attribute. The first call is expected to happen before
+ * threads are created, as for the other flavors.
+ */
+void rcu_init(void)
+{
+	const struct rcu_auto_ops *ops;
+
+	if (rcu_auto_ops)
+		return;
+	/* Probes membarrier(MEMBARRIER_CMD_QUERY) if not already done. */
+	rcu_init_memb();
+	if (rcu_has_sys_membarrier_memb)
+		ops = &rcu_auto_ops_memb;
+	else
+		ops = &rcu_auto_ops_mb;
+	CMM_STORE_SHARED(rcu_auto_flavor, ops->flavor);
+	CMM_STORE_SHARED(rcu_auto_ops, ops);
+}
+
+static const struct rcu_auto_ops *get_ops(void)
+{
+	if (caa_unlikely(!CMM_LOAD_SHARED(rcu_auto_ops)))
+		rcu_init();
+	return rcu_auto_ops;
+}
+
+static const struct rcu_flavor_struct *get_flavor(void)
+{
+	return get_ops()->flavor;
+}
+
+void rcu_read_lock(void)
+{
+	rcu_auto_flavor->read_lock();
+}
+
+void rcu_read_unlock(void)
+{
+	rcu_auto_flavor->read_unlock();
+}
+
+void synchronize_rcu(void)
+{
+	get_flavor()->update_synchronize_rcu();
+}
+
+void synchronize_rcu_expedited(void)
+{
+	get_ops()->synchronize_rcu_expedited();
+}
+
+unsigned long get_state_synchronize_rcu(void)
+{
+	return get_flavor()->update_get_state_synchronize_rcu();
+}
+
+unsigned long start_poll_synchronize_rcu(void)
+{
+	return get_flavor()->update_start_poll_synchronize_rcu();
+}
+
+int poll_state_synchronize_rcu(unsigned long cookie)
+{
+	return get_flavor()->update_poll_state_synchronize_rcu(cookie);
+}
+
+void rcu_get_gp_stats(struct rcu_gp_stats *stats)
+{
+	get_ops()->rcu_get_gp_stats(stats);
+}
+
+void rcu_set_stall_detector(unsigned long timeout_ms,
+		void (*report)(pthread_t tid, unsigned long stall_ms,
+			void *priv),
+		void *priv)
+{
+	get_ops()->rcu_set_stall_detector(timeout_ms, report, priv);
+}
+
+void rcu_gp_driver_start(void)
+{
+	get_ops()->rcu_gp_driver_start();
+}
+
+void rcu_gp_driver_stop(void)
+{
+	get_ops()->rcu_gp_driver_stop();
+}
+
+void rcu_register_thread(void)
+{
+	get_flavor()->register_thread();
+}
+
+void rcu_unregister_thread(void)
+{
+	get_flavor()->unregister_thread();
+}
+
+void call_rcu(struct rcu_head *head,
+	      void (*func)(struct rcu_head *head))
+{
+	get_flavor()->update_call_rcu(head, func);
+}
+
+void free_rcu_head(struct rcu_head *head, unsigned long offset)
+{
+	get_ops()->free_rcu_head(head, offset);
+}
+
+void call_rcu_bulk(struct rcu_head **heads, unsigned long nr,
+		   void (*func)(struct rcu_head *head))
+{
+	get_ops()->call_rcu_bulk(heads, nr, func);
+}
+
+struct call_rcu_data *create_call_rcu_data(unsigned long flags,
+					   int cpu_affinity)
+{
+	return get_ops()->create_call_rcu_data(flags, cpu_affinity);
+}
+
+struct call_rcu_data *create_call_rcu_data_eventfd(unsigned long flags,
+						   int cpu_affinity)
+{
+	return get_ops()->create_call_rcu_data_eventfd(flags, cpu_affinity);
+}
+
+int get_call_rcu_eventfd(struct call_rcu_data *crdp)
+{
+	return get_ops()->get_call_rcu_eventfd(crdp);
+}
+
+unsigned long call_rcu_run_ready(struct call_rcu_data *crdp)
+{
+	return get_ops()->call_rcu_run_ready(crdp);
+}
+
+void call_rcu_data_free(struct call_rcu_data *crdp)
+{
+	get_ops()->call_rcu_data_free(crdp);
+}
+
+struct call_rcu_data *get_default_call_rcu_data(void)
+{
+	return get_ops()->get_default_call_rcu_data();
+}
+
+struct call_rcu_data *get_cpu_call_rcu_data(int cpu)
+{
+	return get_ops()->get_cpu_call_rcu_data(cpu);
+}
+
+struct call_rcu_data *get_thread_call_rcu_data(void)
+{
+	return get_ops()->get_thread_call_rcu_data();
+}
+
+struct call_rcu_data *get_call_rcu_data(void)
+{
+	return get_ops()->get_call_rcu_data();
+}
+
+pthread_t get_call_rcu_thread(struct call_rcu_data *crdp)
+{
+	return get_ops()->get_call_rcu_thread(crdp);
+}
+
+void set_thread_call_rcu_data(struct call_rcu_data *crdp)
+{
+	get_ops()->set_thread_call_rcu_data(crdp);
+}
+
+int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp)
+{
+	return get_ops()->set_cpu_call_rcu_data(cpu, crdp);
+}
+
+int create_all_cpu_call_rcu_data(unsigned long flags)
+{
+	return get_ops()->create_all_cpu_call_rcu_data(flags);
+}
+
+void free_all_cpu_call_rcu_data(void)
+{
+	get_ops()->free_all_cpu_call_rcu_data();
+}
+
+void rcu_barrier(void)
+{
+	get_ops()->rcu_barrier();
+}
+
+void set_call_rcu_data_backlog(struct call_rcu_data *crdp,
+		unsigned long expedite, unsigned long limit)
+{
+	get_ops()->set_call_rcu_data_backlog(crdp, expedite, limit);
+}
+
+void call_rcu_before_fork(void)
+{
+	get_ops()->call_rcu_before_fork();
+}
+
+void call_rcu_after_fork_parent(void)
+{
+	get_ops()->call_rcu_after_fork_parent();
+}
+
+void call_rcu_after_fork_child(void)
+{
+	get_ops()->call_rcu_after_fork_child();
+}
+
+void defer_rcu(void (*fct)(void *p), void *p)
+{
+	get_flavor()->update_defer_rcu(fct, p);
+}
+
+int rcu_defer_register_thread(void)
+{
+	return get_ops()->rcu_defer_register_thread();
+}
+
+void rcu_defer_unregister_thread(void)
+{
+	get_ops()->rcu_defer_unregister_thread();
+}
+
+void rcu_defer_barrier(void)
+{
+	get_ops()->rcu_defer_barrier();
+}
+
+void rcu_defer_barrier_thread(void)
+{
+	get_ops()->rcu_defer_barrier_thread();
+}
+
+void rcu_defer_set_queue_limit(unsigned long nr_entries)
+{
+	get_ops()->rcu_defer_set_queue_limit(nr_entries);
+}
+
+void rcu_defer_set_batch(unsigned long threshold, unsigned long delay_ms)
+{
+	get_ops()->rcu_defer_set_batch(threshold, delay_ms);
+}
+
+/*
+ * Dispatching flavor, used through &rcu_flavor by code which does not
+ * know about liburcu-auto, such as cds_lfht_new().
+ */
+DEFINE_RCU_FLAVOR(rcu_flavor);
@@ -0,0 +1,142 @@
+#ifndef _URCU_AUTO_H
+#define _URCU_AUTO_H
+
+/*
+ * urcu-auto.h
+ *
+ * Userspace RCU header - runtime flavor selection
+ *
+ * liburcu-auto picks a flavor when it is initialized: the membarrier
+ * flavor (liburcu) if the kernel supports
+ * MEMBARRIER_CMD_PRIVATE_EXPEDITED, else the memory barrier flavor
+ * (liburcu-mb). All calls are then forwarded to the selected flavor.
+ *
+ * LGPL-compatible code should include this header with :
+ *
+ * #define _LGPL_SOURCE
+ * #include <urcu-auto.h>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <urcu/map/urcu-auto.h>
+
+/*
+ * Important !
+ *
+ * Each thread containing read-side critical sections must be registered
+ * with rcu_register_thread() before calling rcu_read_lock().
+ * rcu_unregister_thread() should be called before the thread exits.
+ */
+
+/*
+ * See urcu-pointer.h and urcu/static/urcu-pointer.h for pointer
+ * publication headers.
+ */
+#include <urcu-pointer.h>
+
+struct rcu_flavor_struct;
+
+/*
+ * Flavor selected by rcu_init(). Stays NULL until then, and never
+ * changes afterwards. rculfhash users can pass it directly to
+ * cds_lfht_new_flavor() to skip one level of indirection.
+ */
+extern const struct rcu_flavor_struct *rcu_auto_flavor;
+
+#ifndef _LGPL_SOURCE
+extern void rcu_read_lock(void);
+extern void rcu_read_unlock(void);
+#endif
+
+extern void synchronize_rcu(void);
+extern void synchronize_rcu_expedited(void);
+
+extern unsigned long get_state_synchronize_rcu(void);
+extern unsigned long start_poll_synchronize_rcu(void);
+extern int poll_state_synchronize_rcu(unsigned long cookie);
+
+/*
+ * Grace period driver. Between rcu_gp_driver_start() and
+ * rcu_gp_driver_stop(), a dedicated thread performs grace periods back
+ * to back while synchronize_rcu() callers (including call_rcu and defer
+ * threads) are waiting, so they all share the same grace periods
+ * instead of each performing its own.
+ */
+extern void rcu_gp_driver_start(void);
+extern void rcu_gp_driver_stop(void);
+
+/*
+ * Reader thread registration.
+ */
+extern void rcu_register_thread(void);
+extern void rcu_unregister_thread(void);
+
+/*
+ * Explicit rcu initialization, for "early" use within library constructors.
+ * Selects the flavor.
+ */
+extern void rcu_init(void);
+
+/*
+ * Q.S. reporting are no-ops for the flavors liburcu-auto selects from.
+ */
+static inline void rcu_quiescent_state(void)
+{
+}
+
+static inline void rcu_thread_offline(void)
+{
+}
+
+static inline void rcu_thread_online(void)
+{
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <urcu-call-rcu.h>
+#include <urcu-defer.h>
+#include <urcu-gp-stats.h>
+#include <urcu-flavor.h>
+
+#ifdef _LGPL_SOURCE
+
+/*
+ * Calling the selected flavor directly saves a call on the read-side.
+ * Reader threads are registered, hence rcu_auto_flavor is set.
+ */
+static inline void rcu_read_lock(void)
+{
+	rcu_auto_flavor->read_lock();
+}
+
+static inline void rcu_read_unlock(void)
+{
+	rcu_auto_flavor->read_unlock();
+}
+
+#endif /* _LGPL_SOURCE */
+
+#endif /* _URCU_AUTO_H */
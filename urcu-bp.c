@@ -43,6 +43,8 @@
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-gp-stats-impl.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -53,47 +55,8 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
-#ifdef __linux__
-static
-void *mremap_wrapper(void *old_address, size_t old_size,
-		size_t new_size, int flags)
-{
-	return mremap(old_address, old_size, new_size, flags);
-}
-#else
-
-#define MREMAP_MAYMOVE	1
-#define MREMAP_FIXED	2
-
-/*
- * mremap wrapper for non-Linux systems. Maps a RW, anonymous private mapping.
- * This is not generic.
-*/
-static
-void *mremap_wrapper(void *old_address, size_t old_size,
-		size_t new_size, int flags)
-{
-	void *new_address;
-
-	assert(flags & MREMAP_MAYMOVE);
-	assert(!(flags & MREMAP_FIXED));
-	new_address = mmap(old_address, new_size,
-			   PROT_READ | PROT_WRITE,
-			   MAP_ANONYMOUS | MAP_PRIVATE,
-			   -1, 0);
-	if (new_address == MAP_FAILED)
-		return MAP_FAILED;
-	if (old_address) {
-		memcpy(new_address, old_address, old_size);
-		munmap(old_address, old_size);
-	}
-	return new_address;
-}
-#endif
-
 /* Sleep delay in us */
 #define RCU_SLEEP_DELAY		1000
-#define ARENA_INIT_ALLOC	16
 
 /*
  * Active attempts to check for reader Q.S. before calling sleep().
@@ -101,8 +64,17 @@ void *mremap_wrapper(void *old_address, size_t old_size,
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
 void __attribute__((destructor)) rcu_bp_exit(void);
+static void __attribute__((constructor)) rcu_bp_init(void);
 
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static int init_done;
+
+/*
+ * Thread-specific key whose destructor releases the registry entry of
+ * exiting threads.
+ */
+static pthread_key_t rcu_bp_key;
 
 #ifdef DEBUG_YIELD
 unsigned int rcu_yield_active;
@@ -123,21 +95,43 @@ long rcu_gp_ctr = RCU_GP_COUNT;
  */
 DEFINE_URCU_TLS(struct rcu_reader *, rcu_reader);
 
-static CDS_LIST_HEAD(registry);
+/*
+ * The registry is a list of chunks which are never moved nor freed
+ * until the library is unloaded, so readers can keep a pointer to
+ * their entry. Entries are allocated and released by atomically
+ * updating the bitmap of their chunk: allocating an entry takes no
+ * lock and does not need to block signals.
+ */
+#define REGISTRY_CHUNK_LEN	CAA_BITS_PER_LONG
 
-struct registry_arena {
-	void *p;
-	size_t len;
-	size_t used;
+struct registry_chunk {
+	struct registry_chunk *next;
+	unsigned long used;		/* Bitmap of allocated entries */
+	struct rcu_reader readers[REGISTRY_CHUNK_LEN];
 };
 
-static struct registry_arena registry_arena;
+/* New chunks are added at the head with cmpxchg. */
+static struct registry_chunk *registry_chunks;
+
+/*
+ * Grace period sequence counter, used by the polled grace period API.
+ * Odd while a grace period is in progress. Written to only by the
+ * grace period leader with rcu_gp_lock held.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/* Grace period driver thread, see urcu-gp-driver-impl.h. */
+static int rcu_gp_driver_wake(void);
 
 /* Saved fork signal mask, protected by rcu_gp_lock */
 static sigset_t saved_fork_signal_mask;
 
-static void rcu_gc_registry(void);
-
 static void mutex_lock(pthread_mutex_t *mutex)
 {
 	int ret;
@@ -164,11 +158,78 @@ static void mutex_unlock(pthread_mutex_t *mutex)
 		urcu_die(ret);
 }
 
+/*
+ * Report the readers holding up the current grace period, if it has
+ * been stalled for long enough. Called with rcu_gp_lock held.
+ */
+static void report_stalled_readers(void)
+{
+	struct registry_chunk *chunk;
+	unsigned long stall_ms, used;
+	unsigned int i;
+
+	stall_ms = rcu_gp_stall_check();
+	if (caa_likely(!stall_ms))
+		return;
+	for (chunk = CMM_LOAD_SHARED(registry_chunks); chunk;
+			chunk = chunk->next) {
+		used = CMM_LOAD_SHARED(chunk->used);
+		for (i = 0; i < REGISTRY_CHUNK_LEN; i++) {
+			if ((used & (1UL << i))
+			    && rcu_old_gp_ongoing(&chunk->readers[i].ctr))
+				rcu_gp_stall_report(chunk->readers[i].tid,
+					stall_ms);
+		}
+	}
+}
+
+static int registry_empty(void)
+{
+	struct registry_chunk *chunk;
+
+	for (chunk = CMM_LOAD_SHARED(registry_chunks); chunk;
+			chunk = chunk->next) {
+		if (CMM_LOAD_SHARED(chunk->used))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Starting from *chunkp and *slotp, find the first registered reader
+ * holding up the current grace period phase. Returns 0 if there is
+ * none. Readers before this position have been seen quiescent and
+ * cannot hold up the phase anymore, so the next scan resumes from
+ * there. Chunks added to the head meanwhile only hold readers which
+ * registered after the phase began.
+ */
+static int find_ongoing_reader(struct registry_chunk **chunkp,
+		unsigned int *slotp)
+{
+	struct registry_chunk *chunk = *chunkp;
+	unsigned int i = *slotp;
+	unsigned long used;
+
+	for (; chunk; chunk = chunk->next, i = 0) {
+		used = CMM_LOAD_SHARED(chunk->used);
+		for (; i < REGISTRY_CHUNK_LEN; i++) {
+			if ((used & (1UL << i))
+			    && rcu_old_gp_ongoing(&chunk->readers[i].ctr)) {
+				*chunkp = chunk;
+				*slotp = i;
+				return 1;
+			}
+		}
+	}
+	*chunkp = NULL;
+	return 0;
+}
+
 static void update_counter_and_wait(void)
 {
-	CDS_LIST_HEAD(qsreaders);
+	struct registry_chunk *chunk;
+	unsigned int slot = 0;
 	int wait_loops = 0;
-	struct rcu_reader *index, *tmp;
 
 	/* Switch parity: 0 -> 1, 1 -> 0 */
 	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR_PHASE);
@@ -190,28 +251,32 @@ static void update_counter_and_wait(void)
 	/*
 	 * Wait for each thread rcu_reader.ctr count to become 0.
 	 */
+	chunk = CMM_LOAD_SHARED(registry_chunks);
 	for (;;) {
 		wait_loops++;
-		cds_list_for_each_entry_safe(index, tmp, &registry, node) {
-			if (!rcu_old_gp_ongoing(&index->ctr))
-				cds_list_move(&index->node, &qsreaders);
-		}
-
-		if (cds_list_empty(&registry)) {
+		rcu_gp_stats_scan();
+		if (!find_ongoing_reader(&chunk, &slot)) {
 			break;
 		} else {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS)
+			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS)
+				report_stalled_readers();
+			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
+				rcu_gp_stats_futex_wait();
 				usleep(RCU_SLEEP_DELAY);
-			else
+			} else {
 				caa_cpu_relax();
+			}
 		}
 	}
-	/* put back the reader list in the registry */
-	cds_list_splice(&qsreaders, &registry);
 }
 
-void synchronize_rcu(void)
+/*
+ * Perform a grace period on behalf of all threads queued in gp_waiters,
+ * and wake them up.
+ */
+static void lead_grace_period(void)
 {
+	struct urcu_waiters waiters;
 	sigset_t newmask, oldmask;
 	int ret;
 
@@ -222,7 +287,17 @@ void synchronize_rcu(void)
 
 	mutex_lock(&rcu_gp_lock);
 
-	if (cds_list_empty(&registry))
+	/*
+	 * Move all waiters into our local queue.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	rcu_gp_stats_begin();
+	/* Grace period begins: make the sequence odd. */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	cmm_smp_mb();
+
+	if (registry_empty())
 		goto out;
 
 	/* All threads should read qparity before accessing data structure
@@ -230,9 +305,6 @@ void synchronize_rcu(void)
 	/* Write new ptr before changing the qparity */
 	cmm_smp_mb();
 
-	/* Remove old registry elements */
-	rcu_gc_registry();
-
 	/*
 	 * Wait for previous parity to be empty of readers.
 	 */
@@ -256,9 +328,47 @@ void synchronize_rcu(void)
 	 */
 	cmm_smp_mb();
 out:
+	/* Grace period completed: make the sequence even. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	rcu_gp_stats_end();
 	mutex_unlock(&rcu_gp_lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
+
+	/*
+	 * Wakeup waiters only after we have completed the grace period
+	 * and have ensured the memory barriers at the end of the grace
+	 * period have been issued.
+	 */
+	urcu_wake_all_waiters(&waiters);
+}
+
+void synchronize_rcu(void)
+{
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue, and the
+	 * grace period driver thread is not running.
+	 * The implicit memory barrier before urcu_wait_add()
+	 * orders prior memory accesses of threads put into the wait
+	 * queue before their insertion into the wait queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0
+			|| rcu_gp_driver_wake()) {
+		/* Will be awakened by another thread. */
+		urcu_adaptative_busy_wait(&wait);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		return;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
+	lead_grace_period();
 }
 
 /*
@@ -276,113 +386,116 @@ void rcu_read_unlock(void)
 }
 
 /*
- * only grow for now.
+ * Allocate a registry entry, without taking any lock.
  */
-static void resize_arena(struct registry_arena *arena, size_t len)
+static struct rcu_reader *alloc_reader(void)
 {
-	void *new_arena;
-
-	if (!arena->p)
-		new_arena = mmap(arena->p, len,
-				 PROT_READ | PROT_WRITE,
-				 MAP_ANONYMOUS | MAP_PRIVATE,
-				 -1, 0);
-	else
-		new_arena = mremap_wrapper(arena->p, arena->len,
-				   	len, MREMAP_MAYMOVE);
-	assert(new_arena != MAP_FAILED);
-
-	/*
-	 * re-used the same region ?
-	 */
-	if (new_arena == arena->p)
-		return;
+	struct registry_chunk *chunk, *head;
+	unsigned long used;
+	unsigned int i;
+
+	for (chunk = CMM_LOAD_SHARED(registry_chunks); chunk;
+			chunk = chunk->next) {
+		for (;;) {
+			used = uatomic_read(&chunk->used);
+			if (used == ~0UL)
+				break;
+			for (i = 0; used & (1UL << i); i++)
+				;
+			if (uatomic_cmpxchg(&chunk->used, used,
+					used | (1UL << i)) == used)
+				return &chunk->readers[i];
+		}
+	}
 
-	bzero(new_arena + arena->len, len - arena->len);
-	arena->p = new_arena;
+	/* All chunks are full: add a new one, with its first entry taken. */
+	chunk = mmap(NULL, sizeof(*chunk), PROT_READ | PROT_WRITE,
+			MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (chunk == MAP_FAILED)
+		urcu_die(errno);
+	chunk->used = 1UL;
+	do {
+		head = uatomic_read(&registry_chunks);
+		chunk->next = head;
+	} while (uatomic_cmpxchg(&registry_chunks, head, chunk) != head);
+	return &chunk->readers[0];
 }
 
-/* Called with signals off and mutex locked */
-static void add_thread(void)
+static void free_reader(struct rcu_reader *reader)
 {
-	struct rcu_reader *rcu_reader_reg;
+	struct registry_chunk *chunk;
 
-	if (registry_arena.len
-	    < registry_arena.used + sizeof(struct rcu_reader))
-		resize_arena(&registry_arena,
-		caa_max(registry_arena.len << 1, ARENA_INIT_ALLOC));
-	/*
-	 * Find a free spot.
-	 */
-	for (rcu_reader_reg = registry_arena.p;
-	     (void *)rcu_reader_reg < registry_arena.p + registry_arena.len;
-	     rcu_reader_reg++) {
-		if (!rcu_reader_reg->alloc)
+	for (chunk = CMM_LOAD_SHARED(registry_chunks); chunk;
+			chunk = chunk->next) {
+		if (reader >= chunk->readers
+		    && reader < chunk->readers + REGISTRY_CHUNK_LEN)
 			break;
 	}
-	rcu_reader_reg->alloc = 1;
-	registry_arena.used += sizeof(struct rcu_reader);
-
-	/* Add to registry */
-	rcu_reader_reg->tid = pthread_self();
-	assert(rcu_reader_reg->ctr == 0);
-	cds_list_add(&rcu_reader_reg->node, &registry);
-	URCU_TLS(rcu_reader) = rcu_reader_reg;
+	assert(chunk);
+	CMM_STORE_SHARED(reader->ctr, 0);
+	/* Clear ctr before the entry can be reused. */
+	cmm_smp_mb();
+	uatomic_and(&chunk->used, ~(1UL << (reader - chunk->readers)));
 }
 
-/* Called with signals off and mutex locked */
-static void rcu_gc_registry(void)
+static void rcu_bp_thread_exit_notifier(void *rcu_key)
+{
+	URCU_TLS(rcu_reader) = NULL;
+	free_reader(rcu_key);
+}
+
+static void rcu_bp_init(void)
 {
-	struct rcu_reader *rcu_reader_reg;
-	pthread_t tid;
 	int ret;
 
-	for (rcu_reader_reg = registry_arena.p;
-	     (void *)rcu_reader_reg < registry_arena.p + registry_arena.len;
-	     rcu_reader_reg++) {
-		if (!rcu_reader_reg->alloc)
-			continue;
-		tid = rcu_reader_reg->tid;
-		ret = pthread_kill(tid, 0);
-		assert(ret != EINVAL);
-		if (ret == ESRCH) {
-			cds_list_del(&rcu_reader_reg->node);
-			rcu_reader_reg->ctr = 0;
-			rcu_reader_reg->alloc = 0;
-			registry_arena.used -= sizeof(struct rcu_reader);
-		}
+	mutex_lock(&init_lock);
+	if (!init_done) {
+		ret = pthread_key_create(&rcu_bp_key,
+				rcu_bp_thread_exit_notifier);
+		if (ret)
+			urcu_die(ret);
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(init_done, 1);
 	}
+	mutex_unlock(&init_lock);
 }
 
-/* Disable signals, take mutex, add to registry */
+/*
+ * Add to registry. The entry is released by the rcu_bp_key destructor
+ * when the thread exits.
+ */
 void rcu_bp_register(void)
 {
-	sigset_t newmask, oldmask;
+	struct rcu_reader *reader;
 	int ret;
 
-	ret = sigemptyset(&newmask);
-	assert(!ret);
-	ret = pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
-	assert(!ret);
-
+	if (caa_unlikely(!CMM_LOAD_SHARED(init_done)))
+		rcu_bp_init();
+	reader = alloc_reader();
+	reader->tid = pthread_self();
 	/*
-	 * Check if a signal concurrently registered our thread since
-	 * the check in rcu_read_lock(). */
-	if (URCU_TLS(rcu_reader))
-		goto end;
-
-	mutex_lock(&rcu_gp_lock);
-	add_thread();
-	mutex_unlock(&rcu_gp_lock);
-end:
-	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
-	assert(!ret);
+	 * A signal handler may have concurrently registered our thread
+	 * since the check in rcu_read_lock().
+	 */
+	if (uatomic_cmpxchg(&URCU_TLS(rcu_reader), NULL, reader) != NULL) {
+		free_reader(reader);
+		return;
+	}
+	ret = pthread_setspecific(rcu_bp_key, reader);
+	if (ret)
+		urcu_die(ret);
 }
 
 void rcu_bp_exit(void)
 {
-	if (registry_arena.p)
-		munmap(registry_arena.p, registry_arena.len);
+	struct registry_chunk *chunk, *next;
+
+	if (init_done)
+		pthread_key_delete(rcu_bp_key);
+	for (chunk = registry_chunks; chunk; chunk = next) {
+		next = chunk->next;
+		munmap(chunk, sizeof(*chunk));
+	}
 }
 
 /*
@@ -414,12 +527,34 @@ void rcu_bp_after_fork_parent(void)
 	assert(!ret);
 }
 
+/*
+ * Only the calling thread survives in the child: release the registry
+ * entries of all other threads.
+ */
+static void rcu_bp_prune_registry(void)
+{
+	struct registry_chunk *chunk;
+	struct rcu_reader *reader;
+	unsigned int i;
+
+	for (chunk = registry_chunks; chunk; chunk = chunk->next) {
+		for (i = 0; i < REGISTRY_CHUNK_LEN; i++) {
+			reader = &chunk->readers[i];
+			if (!(chunk->used & (1UL << i))
+			    || reader == URCU_TLS(rcu_reader))
+				continue;
+			reader->ctr = 0;
+			chunk->used &= ~(1UL << i);
+		}
+	}
+}
+
 void rcu_bp_after_fork_child(void)
 {
 	sigset_t oldmask;
 	int ret;
 
-	rcu_gc_registry();
+	rcu_bp_prune_registry();
 	oldmask = saved_fork_signal_mask;
 	mutex_unlock(&rcu_gp_lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
@@ -454,3 +589,5 @@ DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
+#include "urcu-gp-driver-impl.h"
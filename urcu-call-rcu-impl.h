@@ -28,20 +28,26 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <sched.h>
+#include <fcntl.h>
 
 #include "config.h"
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #include "urcu/wfcqueue.h"
 #include "urcu-call-rcu.h"
 #include "urcu-pointer.h"
 #include "urcu/list.h"
 #include "urcu/futex.h"
 #include "urcu/tls-compat.h"
+#include "urcu/ref.h"
 #include "urcu-die.h"
 
 /* Data structure that identifies a call_rcu thread. */
@@ -62,8 +68,97 @@ struct call_rcu_data {
 	pthread_t tid;
 	int cpu_affinity;
 	struct cds_list_head list;
+	/* URCU_CALL_RCU_BATCH only */
+	struct cds_list_head batches;	/* Attached call_rcu_batch */
+	pthread_mutex_t batch_lock;	/* Protects batches, splices them */
+	unsigned long batch_size;
+	unsigned long batch_latency;	/* ms */
+	unsigned long batch_delay;	/* Worker sleep, ms */
+	int batch_full;
+	/* URCU_CALL_RCU_HELPERS only */
+	struct cds_wfcq_tail pool_tail;
+	struct cds_wfcq_head pool_head;	/* Callbacks of the current round */
+	struct cds_wfcq_tail pool_barrier_tail;
+	struct cds_wfcq_head pool_barrier_head;	/* Set aside for the worker */
+	int nr_helpers;
+	pthread_t *helper_tids;
+	int32_t pool_gen;		/* Incremented to start a round */
+	int pool_active;		/* Helpers still in the round */
+	int32_t pool_futex;		/* Worker waiting for the helpers */
+	int pool_stop;
+	/* Set by set_call_rcu_data_backlog(), 0 when disabled */
+	unsigned long backlog_expedite;
+	unsigned long backlog_limit;
+	int backlog_waiters;		/* call_rcu() callers over the limit */
+	int32_t backlog_gen;		/* Incremented to wake them up */
+	/* create_call_rcu_data_eventfd() only, event_fd is -1 otherwise */
+	int event_fd;			/* Polled by the application */
+	int event_wfd;			/* Written by the worker */
+	struct cds_wfcq_tail ready_tail;
+	struct cds_wfcq_head ready_head;	/* For call_rcu_run_ready() */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * With URCU_CALL_RCU_BATCH, each thread queues its callbacks into a
+ * batch of its own, attached to a single call_rcu_data at a time, so
+ * call_rcu() does not touch cache lines shared with other threads.
+ * A batch reaching batch_size callbacks is moved to the queue of its
+ * call_rcu_data by its owner, which accounts it in qlen. The worker
+ * also splices the batches at least every batch_latency ms.
+ */
+struct call_rcu_batch {
+	struct cds_wfcq_tail cbs_tail;
+	struct cds_wfcq_head cbs_head;
+	struct call_rcu_data *crdp;	/* NULL if detached */
+	unsigned long count;		/* Owner thread only */
+	struct cds_list_head list;	/* In crdp->batches */
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
+struct call_rcu_completion {
+	int barrier_count;
+	int32_t futex;
+	struct urcu_ref ref;
+};
+
+struct call_rcu_completion_work {
+	struct rcu_head head;
+	struct call_rcu_completion *completion;
+};
+
+/*
+ * free_rcu() queues pointers into page-sized blocks of its thread.
+ * Full blocks are handed to call_rcu() as a single callback, which
+ * frees all their pointers. Partially filled blocks are handed over by
+ * flush_head, a callback queued when the block gets its first pointer.
+ */
+struct free_rcu_block {
+	struct rcu_head head;
+	unsigned long nr;
+	void *ptrs[];
+};
+
+#define FREE_RCU_BLOCK_SIZE	4096
+#define FREE_RCU_BLOCK_LEN						\
+	((FREE_RCU_BLOCK_SIZE - sizeof(struct free_rcu_block)) / sizeof(void *))
+
+struct free_rcu_state {
+	struct free_rcu_block *block;	/* NULL while owner or flush use it */
+	struct rcu_head flush_head;
+	int flush_pending;
+	struct urcu_ref ref;		/* Owner thread and flush_head */
+};
+
+#define CALL_RCU_BATCH_DEFAULT_SIZE	128
+#define CALL_RCU_BATCH_DEFAULT_LATENCY	10	/* ms */
+
+/*
+ * With URCU_CALL_RCU_HELPERS, the worker and its helper threads take
+ * the callbacks of a grace period by chunks of this many.
+ */
+#define CALL_RCU_POOL_CHUNK	64
+
+static void _rcu_barrier_complete(struct rcu_head *head);
+
 /*
  * List of all call_rcu_data structures to keep valgrind happy.
  * Protected by call_rcu_mutex.
@@ -75,6 +170,25 @@ static CDS_LIST_HEAD(call_rcu_data_list);
 
 static DEFINE_URCU_TLS(struct call_rcu_data *, thread_call_rcu_data);
 
+/* Set in call_rcu worker and helper threads, which never block. */
+
+static DEFINE_URCU_TLS(int, thread_call_rcu_worker);
+
+/*
+ * Batch of the current thread, freed by the call_rcu_batch_key
+ * destructor when the thread exits.
+ */
+
+static DEFINE_URCU_TLS(struct call_rcu_batch *, thread_call_rcu_batch);
+static pthread_key_t call_rcu_batch_key;
+static int call_rcu_batch_key_done;	/* Protected by call_rcu_mutex */
+
+/* free_rcu() state of the current thread. */
+
+static DEFINE_URCU_TLS(struct free_rcu_state *, thread_free_rcu);
+static pthread_key_t free_rcu_key;
+static int free_rcu_key_done;		/* Protected by call_rcu_mutex */
+
 /* Guard call_rcu thread creation. */
 
 static pthread_mutex_t call_rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -217,13 +331,393 @@ static void call_rcu_wake_up(struct call_rcu_data *crdp)
 {
 	/* Write to call_rcu list before reading/writing futex */
 	cmm_smp_mb();
-	if (caa_unlikely(uatomic_read(&crdp->futex) == -1)) {
+	if (caa_unlikely(uatomic_read(&crdp->futex) < 0)) {
 		uatomic_set(&crdp->futex, 0);
 		futex_async(&crdp->futex, FUTEX_WAKE, 1,
 		      NULL, NULL, 0);
 	}
 }
 
+/*
+ * Wake up a URCU_CALL_RCU_BATCH worker. While the worker waits for
+ * batches to fill up (futex is -2), only wake it up once one is full.
+ */
+static void call_rcu_batch_wake_up(struct call_rcu_data *crdp, int full)
+{
+	int32_t futex;
+
+	/* Write to batch before reading/writing futex */
+	cmm_smp_mb();
+	futex = uatomic_read(&crdp->futex);
+	if (caa_unlikely(futex == -1 || (futex == -2 && full))) {
+		uatomic_set(&crdp->futex, 0);
+		futex_async(&crdp->futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+}
+
+/* Move the callbacks of all batches attached to crdp to a local queue. */
+static void call_rcu_batch_splice(struct call_rcu_data *crdp,
+		struct cds_wfcq_head *head, struct cds_wfcq_tail *tail)
+{
+	struct call_rcu_batch *batch;
+
+	call_rcu_lock(&crdp->batch_lock);
+	cds_list_for_each_entry(batch, &crdp->batches, list)
+		__cds_wfcq_splice_blocking(head, tail,
+			&batch->cbs_head, &batch->cbs_tail);
+	call_rcu_unlock(&crdp->batch_lock);
+}
+
+static int call_rcu_batch_empty(struct call_rcu_data *crdp)
+{
+	struct call_rcu_batch *batch;
+	int empty = cds_wfcq_empty(&crdp->cbs_head, &crdp->cbs_tail);
+
+	call_rcu_lock(&crdp->batch_lock);
+	cds_list_for_each_entry(batch, &crdp->batches, list) {
+		if (!empty)
+			break;
+		empty = cds_wfcq_empty(&batch->cbs_head, &batch->cbs_tail);
+	}
+	call_rcu_unlock(&crdp->batch_lock);
+	return empty;
+}
+
+/*
+ * Sleep between two URCU_CALL_RCU_BATCH worker iterations. The sleep
+ * shortens while iterations find full batches worth of callbacks, and
+ * lengthens up to batch_latency otherwise. When all queues are empty,
+ * non-RT workers wait to be woken up, then give the new callbacks
+ * batch_latency ms to accumulate.
+ */
+static void call_rcu_batch_wait(struct call_rcu_data *crdp, int rt,
+		unsigned long cbcount)
+{
+	unsigned long delay = crdp->batch_delay;
+	struct timespec timeout;
+
+	if (cbcount >= crdp->batch_size)
+		delay >>= 1;
+	else
+		delay = caa_min(caa_max(delay << 1, 1UL), crdp->batch_latency);
+	if (!rt && call_rcu_batch_empty(crdp)) {
+		uatomic_set(&crdp->futex, -1);
+		/* Write futex before reading call_rcu lists */
+		cmm_smp_mb();
+		if (call_rcu_batch_empty(crdp)
+		    && !(uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP))
+			futex_async(&crdp->futex, FUTEX_WAIT, -1,
+				NULL, NULL, 0);
+		uatomic_set(&crdp->futex, 0);
+		delay = crdp->batch_latency;
+	}
+	crdp->batch_delay = delay;
+	if (!delay)
+		return;
+	if (rt) {
+		poll(NULL, 0, delay);
+		return;
+	}
+	uatomic_set(&crdp->futex, -2);
+	/* Write futex before reading batch_full and flags */
+	cmm_smp_mb();
+	if (!uatomic_read(&crdp->batch_full)
+	    && !(uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP)) {
+		timeout.tv_sec = delay / 1000;
+		timeout.tv_nsec = (delay % 1000) * 1000000;
+		futex_async(&crdp->futex, FUTEX_WAIT, -2,
+			&timeout, NULL, 0);
+	}
+	uatomic_set(&crdp->futex, 0);
+	uatomic_set(&crdp->batch_full, 0);
+}
+
+/*
+ * Past backlog_expedite queued callbacks, the worker performs grace
+ * periods back to back, expedited for flavors providing
+ * synchronize_rcu_expedited(). Their map defines it as a macro.
+ */
+static int call_rcu_backlogged(struct call_rcu_data *crdp)
+{
+	unsigned long expedite = CMM_LOAD_SHARED(crdp->backlog_expedite);
+
+	return expedite && uatomic_read(&crdp->qlen) >= expedite;
+}
+
+static void call_rcu_synchronize(int backlogged)
+{
+#ifdef synchronize_rcu_expedited
+	if (backlogged) {
+		synchronize_rcu_expedited();
+		return;
+	}
+#endif
+	synchronize_rcu();
+}
+
+/* Wake up call_rcu() callers waiting for qlen to drop. */
+static void call_rcu_backlog_wake_up(struct call_rcu_data *crdp)
+{
+	/* Write qlen or flags before reading backlog_waiters */
+	cmm_smp_mb();
+	if (caa_likely(!uatomic_read(&crdp->backlog_waiters)))
+		return;
+	uatomic_inc(&crdp->backlog_gen);
+	futex_async(&crdp->backlog_gen, FUTEX_WAKE, INT_MAX,
+	      NULL, NULL, 0);
+}
+
+/* Invoke the callbacks of a local queue, returning how many there were. */
+static unsigned long call_rcu_invoke(struct cds_wfcq_head *head,
+		struct cds_wfcq_tail *tail)
+{
+	struct cds_wfcq_node *cbs, *cbs_tmp_n;
+	unsigned long cbcount = 0;
+
+	__cds_wfcq_for_each_blocking_safe(head, tail, cbs, cbs_tmp_n) {
+		struct rcu_head *rhp;
+
+		rhp = caa_container_of(cbs, struct rcu_head, next);
+		rhp->func(rhp);
+		cbcount++;
+	}
+	return cbcount;
+}
+
+/*
+ * Move up to CALL_RCU_POOL_CHUNK callbacks of the current round to a
+ * local queue, returning how many were moved.
+ */
+static int call_rcu_pool_take(struct call_rcu_data *crdp,
+		struct cds_wfcq_head *head, struct cds_wfcq_tail *tail)
+{
+	struct cds_wfcq_node *node;
+	int i;
+
+	cds_wfcq_dequeue_lock(&crdp->pool_head, &crdp->pool_tail);
+	for (i = 0; i < CALL_RCU_POOL_CHUNK; i++) {
+		node = __cds_wfcq_dequeue_blocking(&crdp->pool_head,
+				&crdp->pool_tail);
+		if (!node)
+			break;
+		cds_wfcq_node_init(node);
+		cds_wfcq_enqueue(head, tail, node);
+	}
+	cds_wfcq_dequeue_unlock(&crdp->pool_head, &crdp->pool_tail);
+	return i;
+}
+
+/*
+ * Invoke callbacks of the current round until none is left. Chunks are
+ * invoked concurrently and out of order, so rcu_barrier() callbacks are
+ * set aside for the worker to invoke once the round is over.
+ */
+static unsigned long call_rcu_pool_invoke(struct call_rcu_data *crdp)
+{
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+	struct cds_wfcq_node *cbs, *cbs_tmp_n;
+	unsigned long cbcount = 0;
+
+	for (;;) {
+		cds_wfcq_init(&head, &tail);
+		if (!call_rcu_pool_take(crdp, &head, &tail))
+			break;
+		__cds_wfcq_for_each_blocking_safe(&head, &tail, cbs, cbs_tmp_n) {
+			struct rcu_head *rhp;
+
+			rhp = caa_container_of(cbs, struct rcu_head, next);
+			if (caa_unlikely(rhp->func == _rcu_barrier_complete)) {
+				cds_wfcq_node_init(cbs);
+				cds_wfcq_enqueue(&crdp->pool_barrier_head,
+					&crdp->pool_barrier_tail, cbs);
+				continue;
+			}
+			rhp->func(rhp);
+			cbcount++;
+		}
+	}
+	return cbcount;
+}
+
+/* Called by each helper once it finds the round queue empty. */
+static void call_rcu_pool_done(struct call_rcu_data *crdp)
+{
+	/* Invoke callbacks before decrementing pool_active */
+	if (uatomic_sub_return(&crdp->pool_active, 1))
+		return;
+	/* Decrement pool_active before reading futex */
+	if (uatomic_read(&crdp->pool_futex) == -1) {
+		uatomic_set(&crdp->pool_futex, 0);
+		futex_async(&crdp->pool_futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+}
+
+/*
+ * Invoke the callbacks of a grace period, fanning them out to the
+ * helper threads when there is more than a chunk of them. Returns the
+ * number of callbacks invoked.
+ */
+static unsigned long call_rcu_pool_round(struct call_rcu_data *crdp,
+		struct cds_wfcq_head *cbs_head, struct cds_wfcq_tail *cbs_tail,
+		struct cds_wfcq_head *batch_head,
+		struct cds_wfcq_tail *batch_tail)
+{
+	struct cds_wfcq_head barrier_head;
+	struct cds_wfcq_tail barrier_tail;
+	struct cds_wfcq_node *cbs;
+	unsigned long qlen = 0, count, cbcount;
+
+	/* Callbacks still in batches are not accounted in qlen. */
+	__cds_wfcq_for_each_blocking(cbs_head, cbs_tail, cbs)
+		qlen++;
+	count = qlen;
+	__cds_wfcq_for_each_blocking(batch_head, batch_tail, cbs)
+		count++;
+	__cds_wfcq_splice_blocking(&crdp->pool_head, &crdp->pool_tail,
+		cbs_head, cbs_tail);
+	__cds_wfcq_splice_blocking(&crdp->pool_head, &crdp->pool_tail,
+		batch_head, batch_tail);
+	if (count > CALL_RCU_POOL_CHUNK) {
+		uatomic_set(&crdp->pool_active, crdp->nr_helpers);
+		/* Write round queue and pool_active before pool_gen */
+		cmm_smp_mb();
+		uatomic_inc(&crdp->pool_gen);
+		futex_async(&crdp->pool_gen, FUTEX_WAKE, INT_MAX,
+		      NULL, NULL, 0);
+	}
+	cbcount = call_rcu_pool_invoke(crdp);
+	if (count > CALL_RCU_POOL_CHUNK) {
+		rcu_thread_offline();
+		for (;;) {
+			uatomic_set(&crdp->pool_futex, -1);
+			/* Write futex before reading pool_active */
+			cmm_smp_mb();
+			if (!uatomic_read(&crdp->pool_active))
+				break;
+			futex_async(&crdp->pool_futex, FUTEX_WAIT, -1,
+			      NULL, NULL, 0);
+		}
+		uatomic_set(&crdp->pool_futex, 0);
+		rcu_thread_online();
+	}
+	cds_wfcq_init(&barrier_head, &barrier_tail);
+	__cds_wfcq_splice_blocking(&barrier_head, &barrier_tail,
+		&crdp->pool_barrier_head, &crdp->pool_barrier_tail);
+	cbcount += call_rcu_invoke(&barrier_head, &barrier_tail);
+	uatomic_sub(&crdp->qlen, qlen);
+	return cbcount;
+}
+
+/*
+ * Make the event file descriptor readable. An eventfd or a pipe which
+ * cannot be written to is readable already.
+ */
+static void call_rcu_event_signal(struct call_rcu_data *crdp)
+{
+#ifdef HAVE_EVENTFD
+	uint64_t one = 1;
+#else
+	char one = 1;
+#endif
+	ssize_t ret;
+
+	do {
+		ret = write(crdp->event_wfd, &one, sizeof(one));
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0 && errno != EAGAIN)
+		urcu_die(errno);
+}
+
+static void call_rcu_event_clear(struct call_rcu_data *crdp)
+{
+	char buf[64];
+	ssize_t ret;
+
+	do {
+		ret = read(crdp->event_fd, buf, sizeof(buf));
+	} while (ret > 0 || (ret < 0 && errno == EINTR));
+	if (ret < 0 && errno != EAGAIN)
+		urcu_die(errno);
+}
+
+/*
+ * Hand the callbacks of a grace period over to call_rcu_run_ready()
+ * and signal the event file descriptor. Returns the number of
+ * callbacks handed over.
+ */
+static unsigned long call_rcu_ready(struct call_rcu_data *crdp,
+		struct cds_wfcq_head *cbs_head, struct cds_wfcq_tail *cbs_tail,
+		struct cds_wfcq_head *batch_head,
+		struct cds_wfcq_tail *batch_tail)
+{
+	struct cds_wfcq_node *cbs;
+	unsigned long qlen = 0, cbcount;
+
+	/* Callbacks still in batches are not accounted in qlen. */
+	__cds_wfcq_for_each_blocking(cbs_head, cbs_tail, cbs)
+		qlen++;
+	cbcount = qlen;
+	__cds_wfcq_for_each_blocking(batch_head, batch_tail, cbs)
+		cbcount++;
+	__cds_wfcq_splice_blocking(&crdp->ready_head, &crdp->ready_tail,
+		cbs_head, cbs_tail);
+	__cds_wfcq_splice_blocking(&crdp->ready_head, &crdp->ready_tail,
+		batch_head, batch_tail);
+	call_rcu_event_signal(crdp);
+	uatomic_sub(&crdp->qlen, qlen);
+	return cbcount;
+}
+
+/* This is the code run by each URCU_CALL_RCU_HELPERS helper thread. */
+
+static void *call_rcu_helper_thread(void *arg)
+{
+	struct call_rcu_data *crdp = (struct call_rcu_data *) arg;
+	int32_t gen = 0;
+
+	rcu_register_thread();
+	URCU_TLS(thread_call_rcu_data) = crdp;
+	URCU_TLS(thread_call_rcu_worker) = 1;
+	rcu_thread_offline();
+	for (;;) {
+		while (uatomic_read(&crdp->pool_gen) == gen)
+			futex_async(&crdp->pool_gen, FUTEX_WAIT, gen,
+			      NULL, NULL, 0);
+		gen = uatomic_read(&crdp->pool_gen);
+		/* Read pool_gen before reading pool_stop and round queue */
+		cmm_smp_mb();
+		if (uatomic_read(&crdp->pool_stop))
+			break;
+		rcu_thread_online();
+		(void) call_rcu_pool_invoke(crdp);
+		rcu_thread_offline();
+		call_rcu_pool_done(crdp);
+	}
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static void call_rcu_pool_stop(struct call_rcu_data *crdp)
+{
+	int i, ret;
+
+	uatomic_set(&crdp->pool_stop, 1);
+	/* Write pool_stop before pool_gen */
+	cmm_smp_mb();
+	uatomic_inc(&crdp->pool_gen);
+	futex_async(&crdp->pool_gen, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	rcu_thread_offline();
+	for (i = 0; i < crdp->nr_helpers; i++) {
+		ret = pthread_join(crdp->helper_tids[i], NULL);
+		if (ret)
+			urcu_die(ret);
+	}
+	rcu_thread_online();
+}
+
 /* This is the code run by each call_rcu thread. */
 
 static void *call_rcu_thread(void *arg)
@@ -231,7 +725,8 @@ static void *call_rcu_thread(void *arg)
 	unsigned long cbcount;
 	struct call_rcu_data *crdp = (struct call_rcu_data *) arg;
 	int rt = !!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_RT);
-	int ret;
+	int batch = !!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_BATCH);
+	int backlogged, ret;
 
 	ret = set_thread_cpu_affinity(crdp);
 	if (ret)
@@ -243,37 +738,57 @@ static void *call_rcu_thread(void *arg)
 	rcu_register_thread();
 
 	URCU_TLS(thread_call_rcu_data) = crdp;
-	if (!rt) {
+	URCU_TLS(thread_call_rcu_worker) = 1;
+	if (!rt && !batch) {
 		uatomic_dec(&crdp->futex);
 		/* Decrement futex before reading call_rcu list */
 		cmm_smp_mb();
 	}
 	for (;;) {
-		struct cds_wfcq_head cbs_tmp_head;
-		struct cds_wfcq_tail cbs_tmp_tail;
-		struct cds_wfcq_node *cbs, *cbs_tmp_n;
+		struct cds_wfcq_head cbs_tmp_head, batch_tmp_head;
+		struct cds_wfcq_tail cbs_tmp_tail, batch_tmp_tail;
 
 		cds_wfcq_init(&cbs_tmp_head, &cbs_tmp_tail);
 		__cds_wfcq_splice_blocking(&cbs_tmp_head, &cbs_tmp_tail,
 			&crdp->cbs_head, &crdp->cbs_tail);
-		if (!cds_wfcq_empty(&cbs_tmp_head, &cbs_tmp_tail)) {
-			synchronize_rcu();
-			cbcount = 0;
-			__cds_wfcq_for_each_blocking_safe(&cbs_tmp_head,
-					&cbs_tmp_tail, cbs, cbs_tmp_n) {
-				struct rcu_head *rhp;
-
-				rhp = caa_container_of(cbs,
-					struct rcu_head, next);
-				rhp->func(rhp);
-				cbcount++;
+		/* Callbacks still in batches are not accounted in qlen. */
+		cds_wfcq_init(&batch_tmp_head, &batch_tmp_tail);
+		if (batch)
+			call_rcu_batch_splice(crdp, &batch_tmp_head,
+				&batch_tmp_tail);
+		cbcount = 0;
+		backlogged = call_rcu_backlogged(crdp);
+		if (!cds_wfcq_empty(&cbs_tmp_head, &cbs_tmp_tail)
+		    || !cds_wfcq_empty(&batch_tmp_head, &batch_tmp_tail)) {
+			call_rcu_synchronize(backlogged);
+			if (crdp->event_fd >= 0) {
+				cbcount = call_rcu_ready(crdp,
+						&cbs_tmp_head, &cbs_tmp_tail,
+						&batch_tmp_head,
+						&batch_tmp_tail);
+			} else if (crdp->nr_helpers) {
+				cbcount = call_rcu_pool_round(crdp,
+						&cbs_tmp_head, &cbs_tmp_tail,
+						&batch_tmp_head,
+						&batch_tmp_tail);
+			} else {
+				cbcount = call_rcu_invoke(&cbs_tmp_head,
+						&cbs_tmp_tail);
+				uatomic_sub(&crdp->qlen, cbcount);
+				cbcount += call_rcu_invoke(&batch_tmp_head,
+						&batch_tmp_tail);
 			}
-			uatomic_sub(&crdp->qlen, cbcount);
+			call_rcu_backlog_wake_up(crdp);
 		}
 		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP)
 			break;
+		/* Keep going without sleeping while over backlog_expedite. */
+		if (call_rcu_backlogged(crdp))
+			continue;
 		rcu_thread_offline();
-		if (!rt) {
+		if (batch) {
+			call_rcu_batch_wait(crdp, rt, cbcount);
+		} else if (!rt) {
 			if (cds_wfcq_empty(&crdp->cbs_head,
 					&crdp->cbs_tail)) {
 				call_rcu_wait(crdp);
@@ -299,23 +814,49 @@ static void *call_rcu_thread(void *arg)
 		cmm_smp_mb();
 		uatomic_set(&crdp->futex, 0);
 	}
+	if (crdp->nr_helpers)
+		call_rcu_pool_stop(crdp);
 	uatomic_or(&crdp->flags, URCU_CALL_RCU_STOPPED);
 	rcu_unregister_thread();
 	return NULL;
 }
 
+static void call_rcu_event_init(struct call_rcu_data *crdp)
+{
+#ifdef HAVE_EVENTFD
+	crdp->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (crdp->event_fd < 0)
+		urcu_die(errno);
+	crdp->event_wfd = crdp->event_fd;
+#else
+	int fds[2], i;
+
+	if (pipe(fds))
+		urcu_die(errno);
+	for (i = 0; i < 2; i++) {
+		if (fcntl(fds[i], F_SETFL, O_NONBLOCK)
+		    || fcntl(fds[i], F_SETFD, FD_CLOEXEC))
+			urcu_die(errno);
+	}
+	crdp->event_fd = fds[0];
+	crdp->event_wfd = fds[1];
+#endif
+}
+
 /*
  * Create both a call_rcu thread and the corresponding call_rcu_data
  * structure, linking the structure in as specified.  Caller must hold
- * call_rcu_mutex.
+ * call_rcu_mutex.  With "event", callbacks are handed over to
+ * call_rcu_run_ready() instead of being invoked by the thread.
  */
 
 static void call_rcu_data_init(struct call_rcu_data **crdpp,
 			       unsigned long flags,
-			       int cpu_affinity)
+			       int cpu_affinity,
+			       int event)
 {
 	struct call_rcu_data *crdp;
-	int ret;
+	int i, ret;
 
 	crdp = malloc(sizeof(*crdp));
 	if (crdp == NULL)
@@ -327,6 +868,38 @@ static void call_rcu_data_init(struct call_rcu_data **crdpp,
 	crdp->flags = flags;
 	cds_list_add(&crdp->list, &call_rcu_data_list);
 	crdp->cpu_affinity = cpu_affinity;
+	CDS_INIT_LIST_HEAD(&crdp->batches);
+	ret = pthread_mutex_init(&crdp->batch_lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	crdp->batch_size = (flags >> 16) & 0xffffUL;
+	if (!crdp->batch_size)
+		crdp->batch_size = CALL_RCU_BATCH_DEFAULT_SIZE;
+	crdp->batch_latency = (flags >> 8) & 0xffUL;
+	if (!crdp->batch_latency)
+		crdp->batch_latency = CALL_RCU_BATCH_DEFAULT_LATENCY;
+	crdp->batch_delay = crdp->batch_latency;
+	cds_wfcq_init(&crdp->pool_head, &crdp->pool_tail);
+	cds_wfcq_init(&crdp->pool_barrier_head, &crdp->pool_barrier_tail);
+	cds_wfcq_init(&crdp->ready_head, &crdp->ready_tail);
+	crdp->event_fd = crdp->event_wfd = -1;
+	if (event)
+		call_rcu_event_init(crdp);
+	/* Helpers are of no use when callbacks run in the application. */
+	if (!event)
+		crdp->nr_helpers = (flags >> 5) & 0x7UL;
+	if (crdp->nr_helpers) {
+		crdp->helper_tids = calloc(crdp->nr_helpers,
+				sizeof(*crdp->helper_tids));
+		if (crdp->helper_tids == NULL)
+			urcu_die(errno);
+	}
+	for (i = 0; i < crdp->nr_helpers; i++) {
+		ret = pthread_create(&crdp->helper_tids[i], NULL,
+				call_rcu_helper_thread, crdp);
+		if (ret)
+			urcu_die(ret);
+	}
 	cmm_smp_mb();  /* Structure initialized before pointer is planted. */
 	*crdpp = crdp;
 	ret = pthread_create(&crdp->tid, NULL, call_rcu_thread, crdp);
@@ -380,7 +953,7 @@ static struct call_rcu_data *__create_call_rcu_data(unsigned long flags,
 {
 	struct call_rcu_data *crdp;
 
-	call_rcu_data_init(&crdp, flags, cpu_affinity);
+	call_rcu_data_init(&crdp, flags, cpu_affinity, 0);
 	return crdp;
 }
 
@@ -395,6 +968,54 @@ struct call_rcu_data *create_call_rcu_data(unsigned long flags,
 	return crdp;
 }
 
+/*
+ * Create a call_rcu_data structure whose thread only waits for grace
+ * periods: callbacks are then run by call_rcu_run_ready(), once the
+ * file descriptor returned by get_call_rcu_eventfd() is readable.
+ */
+
+struct call_rcu_data *create_call_rcu_data_eventfd(unsigned long flags,
+						   int cpu_affinity)
+{
+	struct call_rcu_data *crdp;
+
+	call_rcu_lock(&call_rcu_mutex);
+	call_rcu_data_init(&crdp, flags, cpu_affinity, 1);
+	call_rcu_unlock(&call_rcu_mutex);
+	return crdp;
+}
+
+/*
+ * Return the file descriptor signalling ready callbacks of a
+ * call_rcu_data structure, or -1 if its thread invokes them.
+ */
+
+int get_call_rcu_eventfd(struct call_rcu_data *crdp)
+{
+	return crdp->event_fd;
+}
+
+/*
+ * Invoke the callbacks of the specified call_rcu_data structure whose
+ * grace period has elapsed, returning how many there were. Clears the
+ * event file descriptor before taking them, so that callbacks handed
+ * over later on make it readable again.
+ */
+
+unsigned long call_rcu_run_ready(struct call_rcu_data *crdp)
+{
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+
+	if (crdp->event_fd < 0)
+		return 0;
+	call_rcu_event_clear(crdp);
+	cds_wfcq_init(&head, &tail);
+	cds_wfcq_splice_blocking(&head, &tail,
+		&crdp->ready_head, &crdp->ready_tail);
+	return call_rcu_invoke(&head, &tail);
+}
+
 /*
  * Set the specified CPU to use the specified call_rcu_data structure.
  *
@@ -456,7 +1077,7 @@ struct call_rcu_data *get_default_call_rcu_data(void)
 		call_rcu_unlock(&call_rcu_mutex);
 		return default_call_rcu_data;
 	}
-	call_rcu_data_init(&default_call_rcu_data, 0, -1);
+	call_rcu_data_init(&default_call_rcu_data, 0, -1, 0);
 	call_rcu_unlock(&call_rcu_mutex);
 	return default_call_rcu_data;
 }
@@ -574,6 +1195,178 @@ static void wake_call_rcu_thread(struct call_rcu_data *crdp)
 		call_rcu_wake_up(crdp);
 }
 
+/*
+ * Move the callbacks of a batch to the queue of crdp. Caller must hold
+ * crdp->batch_lock.
+ *
+ * The owner of the batch keeps appending to it without the lock: take
+ * the callbacks out first, so that qlen accounts for exactly the ones
+ * moved.
+ */
+static void call_rcu_batch_move(struct call_rcu_data *crdp,
+		struct call_rcu_batch *batch)
+{
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+	struct cds_wfcq_node *cbs;
+	unsigned long cbcount = 0;
+
+	cds_wfcq_init(&head, &tail);
+	__cds_wfcq_splice_blocking(&head, &tail,
+		&batch->cbs_head, &batch->cbs_tail);
+	__cds_wfcq_for_each_blocking(&head, &tail, cbs)
+		cbcount++;
+	uatomic_add(&crdp->qlen, cbcount);
+	__cds_wfcq_splice_blocking(&crdp->cbs_head, &crdp->cbs_tail,
+		&head, &tail);
+}
+
+/*
+ * Move the callbacks of a batch to the queue of the call_rcu_data it
+ * is attached to, and detach it. Caller must hold call_rcu_mutex.
+ */
+static void call_rcu_batch_detach(struct call_rcu_batch *batch)
+{
+	struct call_rcu_data *crdp = batch->crdp;
+
+	if (!crdp)
+		return;
+	call_rcu_lock(&crdp->batch_lock);
+	call_rcu_batch_move(crdp, batch);
+	cds_list_del(&batch->list);
+	call_rcu_unlock(&crdp->batch_lock);
+	CMM_STORE_SHARED(batch->crdp, NULL);
+	wake_call_rcu_thread(crdp);
+}
+
+static void call_rcu_batch_exit(void *arg)
+{
+	struct call_rcu_batch *batch = arg;
+
+	call_rcu_lock(&call_rcu_mutex);
+	call_rcu_batch_detach(batch);
+	call_rcu_unlock(&call_rcu_mutex);
+	URCU_TLS(thread_call_rcu_batch) = NULL;
+	free(batch);
+}
+
+/*
+ * Attach the batch of the current thread to crdp, allocating it if
+ * need be. Only called when the thread starts using crdp, so taking
+ * call_rcu_mutex is fine.
+ */
+static struct call_rcu_batch *call_rcu_batch_attach(struct call_rcu_data *crdp)
+{
+	struct call_rcu_batch *batch = URCU_TLS(thread_call_rcu_batch);
+	int ret;
+
+	call_rcu_lock(&call_rcu_mutex);
+	if (!call_rcu_batch_key_done) {
+		ret = pthread_key_create(&call_rcu_batch_key,
+				call_rcu_batch_exit);
+		if (ret)
+			urcu_die(ret);
+		call_rcu_batch_key_done = 1;
+	}
+	if (!batch) {
+		batch = malloc(sizeof(*batch));
+		if (batch == NULL)
+			urcu_die(errno);
+		memset(batch, '\0', sizeof(*batch));
+		cds_wfcq_init(&batch->cbs_head, &batch->cbs_tail);
+		ret = pthread_setspecific(call_rcu_batch_key, batch);
+		if (ret)
+			urcu_die(ret);
+		URCU_TLS(thread_call_rcu_batch) = batch;
+	} else {
+		call_rcu_batch_detach(batch);
+	}
+	batch->count = 0;
+	call_rcu_lock(&crdp->batch_lock);
+	cds_list_add(&batch->list, &crdp->batches);
+	call_rcu_unlock(&crdp->batch_lock);
+	CMM_STORE_SHARED(batch->crdp, crdp);
+	call_rcu_unlock(&call_rcu_mutex);
+	return batch;
+}
+
+/*
+ * Append the chain of nr callbacks from first to last to the batch of
+ * the current thread. crdp cannot be freed concurrently, because we
+ * hold the RCU read-side lock: the batch is therefore still attached
+ * to it if batch->crdp == crdp. Returns whether the batch was full,
+ * and has been moved to crdp.
+ */
+static int call_rcu_batch_enqueue(struct call_rcu_data *crdp,
+		struct rcu_head *first, struct rcu_head *last,
+		unsigned long nr)
+{
+	struct call_rcu_batch *batch = URCU_TLS(thread_call_rcu_batch);
+	int full = 0;
+
+	if (caa_unlikely(!batch || CMM_LOAD_SHARED(batch->crdp) != crdp))
+		batch = call_rcu_batch_attach(crdp);
+	___cds_wfcq_append(&batch->cbs_head, &batch->cbs_tail,
+		&first->next, &last->next);
+	batch->count += nr;
+	if (batch->count >= crdp->batch_size) {
+		batch->count = 0;
+		call_rcu_lock(&crdp->batch_lock);
+		call_rcu_batch_move(crdp, batch);
+		call_rcu_unlock(&crdp->batch_lock);
+		uatomic_set(&crdp->batch_full, 1);
+		full = 1;
+	}
+	if (!(_CMM_LOAD_SHARED(crdp->flags) & URCU_CALL_RCU_RT))
+		call_rcu_batch_wake_up(crdp, full);
+	return full;
+}
+
+/*
+ * Wait for the backlog of crdp to drop below backlog_limit, unless
+ * called from within a RCU read-side critical section, or from an
+ * online QSBR thread: such a thread may still use RCU-protected data
+ * across call_rcu(), so it cannot be put offline here. backlog_waiters
+ * keeps crdp from being freed until we are done with it.
+ */
+static void call_rcu_backlog_wait(struct call_rcu_data *crdp)
+{
+	int32_t gen;
+
+	uatomic_inc(&crdp->backlog_waiters);
+	rcu_read_unlock();
+	if (_rcu_read_ongoing())
+		goto end;
+	for (;;) {
+		gen = uatomic_read(&crdp->backlog_gen);
+		/* Read backlog_gen before reading qlen and flags */
+		cmm_smp_mb();
+		if (uatomic_read(&crdp->qlen)
+				< CMM_LOAD_SHARED(crdp->backlog_limit)
+		    || (uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOPPED))
+			break;
+		futex_async(&crdp->backlog_gen, FUTEX_WAIT, gen,
+		      NULL, NULL, 0);
+	}
+end:
+	rcu_read_lock();
+	/* Last access to crdp */
+	uatomic_dec(&crdp->backlog_waiters);
+}
+
+/*
+ * Called after queueing callbacks on crdp, with the RCU read-side lock
+ * held.
+ */
+static void call_rcu_backlog_check(struct call_rcu_data *crdp)
+{
+	unsigned long limit = CMM_LOAD_SHARED(crdp->backlog_limit);
+
+	if (caa_unlikely(limit && uatomic_read(&crdp->qlen) >= limit)
+	    && !URCU_TLS(thread_call_rcu_worker))
+		call_rcu_backlog_wait(crdp);
+}
+
 /*
  * Schedule a function to be invoked after a following grace period.
  * This is the only function that must be called -- the others are
@@ -588,7 +1381,6 @@ static void wake_call_rcu_thread(struct call_rcu_data *crdp)
  *
  * call_rcu must be called by registered RCU read-side threads.
  */
-
 void call_rcu(struct rcu_head *head,
 	      void (*func)(struct rcu_head *head))
 {
@@ -599,12 +1391,73 @@ void call_rcu(struct rcu_head *head,
 	/* Holding rcu read-side lock across use of per-cpu crdp */
 	rcu_read_lock();
 	crdp = get_call_rcu_data();
-	cds_wfcq_enqueue(&crdp->cbs_head, &crdp->cbs_tail, &head->next);
-	uatomic_inc(&crdp->qlen);
-	wake_call_rcu_thread(crdp);
+	if (_CMM_LOAD_SHARED(crdp->flags) & URCU_CALL_RCU_BATCH) {
+		if (call_rcu_batch_enqueue(crdp, head, head, 1))
+			call_rcu_backlog_check(crdp);
+	} else {
+		cds_wfcq_enqueue(&crdp->cbs_head, &crdp->cbs_tail,
+			&head->next);
+		uatomic_inc(&crdp->qlen);
+		wake_call_rcu_thread(crdp);
+		call_rcu_backlog_check(crdp);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Schedule "func" to be invoked on each of the "nr" callbacks of the
+ * "heads" array after a following grace period. The callbacks are
+ * linked together without atomic operations, then appended to the
+ * call_rcu thread queue at once.
+ *
+ * call_rcu_bulk must be called by registered RCU read-side threads.
+ */
+void call_rcu_bulk(struct rcu_head **heads, unsigned long nr,
+		   void (*func)(struct rcu_head *head))
+{
+	struct call_rcu_data *crdp;
+	unsigned long i;
+
+	if (!nr)
+		return;
+	for (i = 0; i < nr - 1; i++) {
+		heads[i]->func = func;
+		heads[i]->next.next = &heads[i + 1]->next;
+	}
+	heads[nr - 1]->func = func;
+	cds_wfcq_node_init(&heads[nr - 1]->next);
+	/* Holding rcu read-side lock across use of per-cpu crdp */
+	rcu_read_lock();
+	crdp = get_call_rcu_data();
+	if (_CMM_LOAD_SHARED(crdp->flags) & URCU_CALL_RCU_BATCH) {
+		if (call_rcu_batch_enqueue(crdp, heads[0], heads[nr - 1], nr))
+			call_rcu_backlog_check(crdp);
+	} else {
+		___cds_wfcq_append(&crdp->cbs_head, &crdp->cbs_tail,
+			&heads[0]->next, &heads[nr - 1]->next);
+		uatomic_add(&crdp->qlen, nr);
+		wake_call_rcu_thread(crdp);
+		call_rcu_backlog_check(crdp);
+	}
 	rcu_read_unlock();
 }
 
+/*
+ * Set the backlog marks of the specified call_rcu_data structure: past
+ * "expedite" queued callbacks, its thread performs grace periods back
+ * to back; past "limit", call_rcu() waits for the backlog to drop back
+ * below "limit". Zero disables either mark.
+ */
+void set_call_rcu_data_backlog(struct call_rcu_data *crdp,
+		unsigned long expedite, unsigned long limit)
+{
+	CMM_STORE_SHARED(crdp->backlog_expedite, expedite);
+	CMM_STORE_SHARED(crdp->backlog_limit, limit);
+	/* Let waiters see a raised or removed limit. */
+	call_rcu_backlog_wake_up(crdp);
+	wake_call_rcu_thread(crdp);
+}
+
 /*
  * Free up the specified call_rcu_data structure, terminating the
  * associated call_rcu thread.  The caller must have previously
@@ -633,6 +1486,8 @@ void call_rcu(struct rcu_head *head,
  */
 void call_rcu_data_free(struct call_rcu_data *crdp)
 {
+	struct call_rcu_batch *batch, *tmp;
+
 	if (crdp == NULL || crdp == default_call_rcu_data) {
 		return;
 	}
@@ -642,9 +1497,23 @@ void call_rcu_data_free(struct call_rcu_data *crdp)
 		while ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOPPED) == 0)
 			poll(NULL, 0, 1);
 	}
+	/* Release call_rcu() callers waiting on the backlog. */
+	call_rcu_backlog_wake_up(crdp);
+	while (uatomic_read(&crdp->backlog_waiters))
+		poll(NULL, 0, 1);
+	/*
+	 * Move leftover callbacks and remove crdp from the list with
+	 * call_rcu_mutex held, so rcu_barrier() either queues its
+	 * callback before they are moved, or does not see crdp.
+	 */
+	call_rcu_lock(&call_rcu_mutex);
+	/* Batches reattach to another call_rcu_data on next call_rcu(). */
+	cds_list_for_each_entry_safe(batch, tmp, &crdp->batches, list)
+		call_rcu_batch_detach(batch);
 	if (!cds_wfcq_empty(&crdp->cbs_head, &crdp->cbs_tail)) {
 		/* Create default call rcu data if need be */
-		(void) get_default_call_rcu_data();
+		if (default_call_rcu_data == NULL)
+			call_rcu_data_init(&default_call_rcu_data, 0, -1, 0);
 		__cds_wfcq_splice_blocking(&default_call_rcu_data->cbs_head,
 			&default_call_rcu_data->cbs_tail,
 			&crdp->cbs_head, &crdp->cbs_tail);
@@ -652,11 +1521,17 @@ void call_rcu_data_free(struct call_rcu_data *crdp)
 			    uatomic_read(&crdp->qlen));
 		wake_call_rcu_thread(default_call_rcu_data);
 	}
-
-	call_rcu_lock(&call_rcu_mutex);
 	cds_list_del(&crdp->list);
 	call_rcu_unlock(&call_rcu_mutex);
 
+	if (crdp->event_fd >= 0) {
+		(void) call_rcu_run_ready(crdp);
+		if (crdp->event_wfd != crdp->event_fd)
+			(void) close(crdp->event_wfd);
+		(void) close(crdp->event_fd);
+	}
+	pthread_mutex_destroy(&crdp->batch_lock);
+	free(crdp->helper_tids);
 	free(crdp);
 }
 
@@ -700,6 +1575,263 @@ void free_all_cpu_call_rcu_data(void)
 	free(crdp);
 }
 
+static void call_rcu_completion_wait(struct call_rcu_completion *completion)
+{
+	/* Read completion barrier count before read futex */
+	cmm_smp_mb();
+	if (uatomic_read(&completion->futex) == -1)
+		futex_async(&completion->futex, FUTEX_WAIT, -1,
+		      NULL, NULL, 0);
+}
+
+static void call_rcu_completion_wake_up(struct call_rcu_completion *completion)
+{
+	/* Write to completion barrier count before reading/writing futex */
+	cmm_smp_mb();
+	if (caa_unlikely(uatomic_read(&completion->futex) == -1)) {
+		uatomic_set(&completion->futex, 0);
+		futex_async(&completion->futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+}
+
+static void free_completion(struct urcu_ref *ref)
+{
+	struct call_rcu_completion *completion;
+
+	completion = caa_container_of(ref, struct call_rcu_completion, ref);
+	free(completion);
+}
+
+static void _rcu_barrier_complete(struct rcu_head *head)
+{
+	struct call_rcu_completion_work *work;
+	struct call_rcu_completion *completion;
+
+	work = caa_container_of(head, struct call_rcu_completion_work, head);
+	completion = work->completion;
+	if (!uatomic_sub_return(&completion->barrier_count, 1))
+		call_rcu_completion_wake_up(completion);
+	urcu_ref_put(&completion->ref, free_completion);
+	free(work);
+}
+
+/*
+ * Wait for all callbacks queued by call_rcu() before this call to have
+ * been invoked. A completion callback is queued on each call_rcu_data,
+ * after the callbacks of its attached batches, and the caller sleeps
+ * until all of them have run. The completion is reference counted, as
+ * the last callback may still wake it up after rcu_barrier() returned.
+ *
+ * Must not be called from a RCU read-side critical section, nor from
+ * a call_rcu callback. QSBR threads are put offline while waiting.
+ */
+void rcu_barrier(void)
+{
+	struct call_rcu_data *crdp;
+	struct call_rcu_batch *batch;
+	struct call_rcu_completion *completion;
+	struct call_rcu_completion_work *work;
+	int count = 0;
+	int was_online;
+
+	/* Put in offline state in QSBR. */
+	was_online = _rcu_read_ongoing();
+	if (was_online)
+		rcu_thread_offline();
+	/*
+	 * Calling a rcu_barrier() within a RCU read-side critical
+	 * section is an error.
+	 */
+	if (_rcu_read_ongoing()) {
+		static int warned = 0;
+
+		if (!warned) {
+			fprintf(stderr, "[error] liburcu: rcu_barrier() called from within RCU read-side critical section.\n");
+		}
+		warned = 1;
+		goto online;
+	}
+
+	completion = calloc(1, sizeof(*completion));
+	if (!completion)
+		urcu_die(errno);
+
+	call_rcu_lock(&call_rcu_mutex);
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
+		count++;
+
+	/* Referenced by rcu_barrier() and all call_rcu thread worker. */
+	urcu_ref_set(&completion->ref, count + 1);
+	completion->barrier_count = count;
+
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
+		work = malloc(sizeof(*work));
+		if (!work)
+			urcu_die(errno);
+		work->completion = completion;
+		cds_wfcq_node_init(&work->head.next);
+		work->head.func = _rcu_barrier_complete;
+		call_rcu_lock(&crdp->batch_lock);
+		cds_list_for_each_entry(batch, &crdp->batches, list)
+			call_rcu_batch_move(crdp, batch);
+		cds_wfcq_enqueue(&crdp->cbs_head, &crdp->cbs_tail,
+			&work->head.next);
+		call_rcu_unlock(&crdp->batch_lock);
+		uatomic_inc(&crdp->qlen);
+		wake_call_rcu_thread(crdp);
+	}
+	call_rcu_unlock(&call_rcu_mutex);
+
+	/* Wait for them */
+	for (;;) {
+		uatomic_dec(&completion->futex);
+		/* Decrement futex before reading barrier_count */
+		cmm_smp_mb();
+		if (!uatomic_read(&completion->barrier_count))
+			break;
+		call_rcu_completion_wait(completion);
+	}
+
+	urcu_ref_put(&completion->ref, free_completion);
+
+online:
+	if (was_online)
+		rcu_thread_online();
+}
+
+static void free_rcu_block_func(struct rcu_head *head)
+{
+	struct free_rcu_block *block;
+	unsigned long i;
+
+	block = caa_container_of(head, struct free_rcu_block, head);
+	for (i = 0; i < block->nr; i++)
+		free(block->ptrs[i]);
+	free(block);
+}
+
+static void free_rcu_state_release(struct urcu_ref *ref)
+{
+	free(caa_container_of(ref, struct free_rcu_state, ref));
+}
+
+/*
+ * Runs a grace period after the current block of the thread got its
+ * first pointer. Pointers may have been added since, so the block
+ * waits for another grace period.
+ */
+static void free_rcu_flush(struct rcu_head *head)
+{
+	struct free_rcu_state *state;
+	struct free_rcu_block *block;
+
+	state = caa_container_of(head, struct free_rcu_state, flush_head);
+	/*
+	 * Clear flush_pending before taking the block (xchg implies a
+	 * memory barrier): the owner either sees it cleared and queues
+	 * another flush, or has put its block back before we take it.
+	 */
+	uatomic_set(&state->flush_pending, 0);
+	block = uatomic_xchg(&state->block, NULL);
+	if (block)
+		call_rcu(&block->head, free_rcu_block_func);
+	urcu_ref_put(&state->ref, free_rcu_state_release);
+}
+
+/*
+ * Thread exit: hand the current block to the default call_rcu_data,
+ * without relying on the thread still being registered.
+ */
+static void free_rcu_state_exit(void *arg)
+{
+	struct free_rcu_state *state = arg;
+	struct free_rcu_block *block;
+
+	block = uatomic_xchg(&state->block, NULL);
+	if (block) {
+		cds_wfcq_node_init(&block->head.next);
+		block->head.func = free_rcu_block_func;
+		call_rcu_lock(&call_rcu_mutex);
+		if (default_call_rcu_data == NULL)
+			call_rcu_data_init(&default_call_rcu_data, 0, -1, 0);
+		cds_wfcq_enqueue(&default_call_rcu_data->cbs_head,
+			&default_call_rcu_data->cbs_tail, &block->head.next);
+		uatomic_inc(&default_call_rcu_data->qlen);
+		wake_call_rcu_thread(default_call_rcu_data);
+		call_rcu_unlock(&call_rcu_mutex);
+	}
+	URCU_TLS(thread_free_rcu) = NULL;
+	urcu_ref_put(&state->ref, free_rcu_state_release);
+}
+
+static struct free_rcu_state *free_rcu_state_alloc(void)
+{
+	struct free_rcu_state *state;
+	int ret;
+
+	call_rcu_lock(&call_rcu_mutex);
+	if (!free_rcu_key_done) {
+		ret = pthread_key_create(&free_rcu_key, free_rcu_state_exit);
+		if (ret)
+			urcu_die(ret);
+		free_rcu_key_done = 1;
+	}
+	call_rcu_unlock(&call_rcu_mutex);
+	state = calloc(1, sizeof(*state));
+	if (!state)
+		return NULL;
+	urcu_ref_init(&state->ref);
+	ret = pthread_setspecific(free_rcu_key, state);
+	if (ret)
+		urcu_die(ret);
+	URCU_TLS(thread_free_rcu) = state;
+	return state;
+}
+
+/*
+ * Backend of free_rcu(). The thread takes and puts back its block
+ * with xchg, so free_rcu_flush() can take it meanwhile, but the cache
+ * line is not shared with other threads in the common case.
+ */
+void free_rcu_head(struct rcu_head *head, unsigned long offset)
+{
+	struct free_rcu_state *state = URCU_TLS(thread_free_rcu);
+	struct free_rcu_block *block = NULL;
+
+	if (caa_unlikely(!state))
+		state = free_rcu_state_alloc();
+	if (caa_likely(state)) {
+		block = uatomic_xchg(&state->block, NULL);
+		if (!block) {
+			block = malloc(FREE_RCU_BLOCK_SIZE);
+			if (block)
+				block->nr = 0;
+		}
+	}
+	if (caa_unlikely(!block)) {
+		/* Without memory for a block, wait for the grace period. */
+		synchronize_rcu();
+		free((char *) head - offset);
+		return;
+	}
+	block->ptrs[block->nr++] = (char *) head - offset;
+	if (block->nr == FREE_RCU_BLOCK_LEN) {
+		call_rcu(&block->head, free_rcu_block_func);
+		return;
+	}
+	/*
+	 * Write block content and put it back before reading
+	 * flush_pending (xchg implies memory barriers).
+	 */
+	(void) uatomic_xchg(&state->block, block);
+	if (!uatomic_read(&state->flush_pending)) {
+		uatomic_set(&state->flush_pending, 1);
+		urcu_ref_get(&state->ref);
+		call_rcu(&state->flush_head, free_rcu_flush);
+	}
+}
+
 /*
  * Acquire the call_rcu_mutex in order to ensure that the child sees
  * all of the call_rcu() data structures in a consistent state.
@@ -707,7 +1839,11 @@ void free_all_cpu_call_rcu_data(void)
  */
 void call_rcu_before_fork(void)
 {
+	struct call_rcu_data *crdp;
+
 	call_rcu_lock(&call_rcu_mutex);
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
+		call_rcu_lock(&crdp->batch_lock);
 }
 
 /*
@@ -717,6 +1853,10 @@ void call_rcu_before_fork(void)
  */
 void call_rcu_after_fork_parent(void)
 {
+	struct call_rcu_data *crdp;
+
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
+		call_rcu_unlock(&crdp->batch_lock);
 	call_rcu_unlock(&call_rcu_mutex);
 }
 
@@ -729,7 +1869,9 @@ void call_rcu_after_fork_child(void)
 {
 	struct call_rcu_data *crdp, *next;
 
-	/* Release the mutex. */
+	/* Release the mutexes. */
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
+		call_rcu_unlock(&crdp->batch_lock);
 	call_rcu_unlock(&call_rcu_mutex);
 
 	/* Do nothing when call_rcu() has not been used */
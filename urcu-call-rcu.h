@@ -48,6 +48,22 @@ struct call_rcu_data;
 #define URCU_CALL_RCU_RUNNING	0x2
 #define URCU_CALL_RCU_STOP	0x4
 #define URCU_CALL_RCU_STOPPED	0x8
+#define URCU_CALL_RCU_BATCH	0x10
+
+/*
+ * Batching parameters for URCU_CALL_RCU_BATCH, to be or'd with the
+ * flags: number of callbacks queued by a thread before the worker is
+ * woken up (at most 65535), and longest time a callback waits in the
+ * batch of its thread, in ms (at most 255). Zero selects the default.
+ */
+#define URCU_CALL_RCU_BATCH_SIZE(n)	(((unsigned long) (n) & 0xffffUL) << 16)
+#define URCU_CALL_RCU_BATCH_LATENCY(ms)	(((unsigned long) (ms) & 0xffUL) << 8)
+
+/*
+ * Number of helper threads invoking callbacks along with the worker
+ * (at most 7), to be or'd with the flags.
+ */
+#define URCU_CALL_RCU_HELPERS(n)	(((unsigned long) (n) & 0x7UL) << 5)
 
 /*
  * The rcu_head data structure is placed in the structure to be freed
@@ -69,9 +85,27 @@ struct rcu_head {
 
 void call_rcu(struct rcu_head *head,
 	      void (*func)(struct rcu_head *head));
+void call_rcu_bulk(struct rcu_head **heads, unsigned long nr,
+		   void (*func)(struct rcu_head *head));
+
+/*
+ * free() the structure pointed to by "ptr" after a grace period, without
+ * a callback. "rhf" is the name of its struct rcu_head member. Waits
+ * for the grace period with synchronize_rcu() when out of memory, so it
+ * must not be called from within a read-side critical section.
+ */
+#define free_rcu(ptr, rhf)						\
+	free_rcu_head(&(ptr)->rhf,					\
+		(unsigned long) &((__typeof__(ptr)) 0)->rhf)
+
+void free_rcu_head(struct rcu_head *head, unsigned long offset);
 
 struct call_rcu_data *create_call_rcu_data(unsigned long flags,
 					   int cpu_affinity);
+struct call_rcu_data *create_call_rcu_data_eventfd(unsigned long flags,
+						   int cpu_affinity);
+int get_call_rcu_eventfd(struct call_rcu_data *crdp);
+unsigned long call_rcu_run_ready(struct call_rcu_data *crdp);
 void call_rcu_data_free(struct call_rcu_data *crdp);
 
 struct call_rcu_data *get_default_call_rcu_data(void);
@@ -86,6 +120,11 @@ int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp);
 int create_all_cpu_call_rcu_data(unsigned long flags);
 void free_all_cpu_call_rcu_data(void);
 
+void rcu_barrier(void);
+
+void set_call_rcu_data_backlog(struct call_rcu_data *crdp,
+		unsigned long expedite, unsigned long limit);
+
 void call_rcu_before_fork(void);
 void call_rcu_after_fork_parent(void);
 void call_rcu_after_fork_child(void);
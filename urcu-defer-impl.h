@@ -52,11 +52,26 @@
 #include "urcu-die.h"
 
 /*
- * Number of entries in the per-thread defer queue. Must be power of 2.
+ * Number of entries in each segment of the per-thread defer queue. Must
+ * be power of 2. Each segment has an extra slot linking to the next one.
  */
 #define DEFER_QUEUE_SIZE	(1 << 12)
 #define DEFER_QUEUE_MASK	(DEFER_QUEUE_SIZE - 1)
 
+/*
+ * Default limit on the number of segments of a thread, including its
+ * spare segment: 32 segments are 1MB on 64-bit.
+ */
+#define DEFER_QUEUE_DEFAULT_SEGMENTS	32
+
+/*
+ * Default batching of the defer thread: callbacks are given up to
+ * DEFER_BATCH_DEFAULT_DELAY ms to accumulate, unless a thread queue
+ * reaches DEFER_BATCH_DEFAULT_THRESHOLD entries.
+ */
+#define DEFER_BATCH_DEFAULT_DELAY	100
+#define DEFER_BATCH_DEFAULT_THRESHOLD	DEFER_QUEUE_SIZE
+
 /*
  * Typically, data is aligned at least on the architecture size.
  * Use lowest bit to indicate that the current callback is changing.
@@ -92,6 +107,14 @@
 
 /*
  * defer queue.
+ * Chain of segments: the owner thread adds elements to the segment q,
+ * the reclamation side removes them from the segment q_tail. Once the
+ * last element of a segment is added, the owner links a new one after
+ * it, taken from the spare segment recycled by the reclamation side, or
+ * allocated if the thread has less than defer_queue_max_segments. When
+ * it can get neither, the owner empties the queue itself, which
+ * recycles a segment: there are always at least two of them.
+ *
  * Contains pointers. Encoded to save space when same callback is often used.
  * When looking up the next item:
  * - if DQ_FCT_BIT is set, set the current callback to DQ_CLEAR_FCT_BIT(ptr)
@@ -106,7 +129,10 @@ struct defer_queue {
 	void *last_fct_in;	/* last fct pointer encoded */
 	unsigned long tail;	/* next element to remove at tail */
 	void *last_fct_out;	/* last fct pointer encoded */
-	void **q;
+	void **q;		/* segment of head */
+	void **q_tail;		/* segment of tail */
+	void **spare;
+	unsigned long nr_segments;
 	/* registry information */
 	unsigned long last_head;
 	struct cds_list_head list;	/* list of thread queues */
@@ -128,6 +154,10 @@ static pthread_mutex_t defer_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int32_t defer_thread_futex;
 static int32_t defer_thread_stop;
 
+static unsigned long defer_queue_max_segments = DEFER_QUEUE_DEFAULT_SEGMENTS;
+static unsigned long defer_batch_delay = DEFER_BATCH_DEFAULT_DELAY;
+static unsigned long defer_batch_threshold = DEFER_BATCH_DEFAULT_THRESHOLD;
+
 /*
  * Written to only by each individual deferer. Read by both the deferer and
  * the reclamation tread.
@@ -165,6 +195,19 @@ static void wake_up_defer(void)
 	}
 }
 
+/*
+ * Ends the batching delay of the defer thread, if it is waiting for
+ * callbacks to accumulate (futex set to -2).
+ */
+static void wake_up_defer_batch(void)
+{
+	if (caa_unlikely(uatomic_read(&defer_thread_futex) == -2)) {
+		uatomic_set(&defer_thread_futex, 0);
+		futex_noasync(&defer_thread_futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+}
+
 static unsigned long rcu_defer_num_callbacks(void)
 {
 	unsigned long num_items = 0, head;
@@ -204,6 +247,67 @@ static void wait_defer(void)
 	}
 }
 
+/*
+ * Give callbacks defer_batch_delay ms to accumulate, unless the queues
+ * already hold defer_batch_threshold entries, or until a thread queue
+ * reaches that many.
+ */
+static void wait_defer_batch(void)
+{
+	unsigned long delay = CMM_LOAD_SHARED(defer_batch_delay);
+	struct timespec timeout;
+
+	if (!delay)
+		return;
+	uatomic_set(&defer_thread_futex, -2);
+	/* Write futex before read queue */
+	/* Write futex before read defer_thread_stop */
+	cmm_smp_mb();
+	if (!_CMM_LOAD_SHARED(defer_thread_stop)
+	    && rcu_defer_num_callbacks()
+			< CMM_LOAD_SHARED(defer_batch_threshold)) {
+		timeout.tv_sec = delay / 1000;
+		timeout.tv_nsec = (delay % 1000) * 1000000;
+		futex_noasync(&defer_thread_futex, FUTEX_WAIT, -2,
+		      &timeout, NULL, 0);
+	}
+	uatomic_set(&defer_thread_futex, 0);
+}
+
+static void **defer_segment_alloc(void)
+{
+	return malloc(sizeof(void *) * (DEFER_QUEUE_SIZE + 1));
+}
+
+/*
+ * Recycle a segment the reclamation side is done with: keep it as
+ * spare, or free it if the owner has one already.
+ */
+static void defer_segment_put(struct defer_queue *queue, void **seg)
+{
+	if (uatomic_cmpxchg(&queue->spare, NULL, seg) == NULL)
+		return;
+	free(seg);
+	uatomic_dec(&queue->nr_segments);
+}
+
+/*
+ * Remove element i, moving on to the next segment after the last
+ * element of a segment.
+ */
+static void *defer_queue_pop(struct defer_queue *queue, unsigned long *i)
+{
+	void **q = queue->q_tail;
+	void *p;
+
+	p = CMM_LOAD_SHARED(q[*i & DEFER_QUEUE_MASK]);
+	if (caa_unlikely((++*i & DEFER_QUEUE_MASK) == 0)) {
+		queue->q_tail = CMM_LOAD_SHARED(q[DEFER_QUEUE_SIZE]);
+		defer_segment_put(queue, q);
+	}
+	return p;
+}
+
 /*
  * Must be called after Q.S. is reached.
  */
@@ -221,15 +325,15 @@ static void rcu_defer_barrier_queue(struct defer_queue *queue,
 
 	for (i = queue->tail; i != head;) {
 		cmm_smp_rmb();       /* read head before q[]. */
-		p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+		p = defer_queue_pop(queue, &i);
 		if (caa_unlikely(DQ_IS_FCT_BIT(p))) {
 			DQ_CLEAR_FCT_BIT(p);
 			queue->last_fct_out = p;
-			p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+			p = defer_queue_pop(queue, &i);
 		} else if (caa_unlikely(p == DQ_FCT_MARK)) {
-			p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+			p = defer_queue_pop(queue, &i);
 			queue->last_fct_out = p;
-			p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+			p = defer_queue_pop(queue, &i);
 		}
 		fct = queue->last_fct_out;
 		fct(p);
@@ -297,29 +401,68 @@ end:
 	mutex_unlock(&rcu_defer_mutex);
 }
 
+/*
+ * Get a segment to link after the current one: the spare, a new one
+ * below the limit, or else the one recycled once we have emptied our
+ * queue, which only contains elements before head. Emptying the queue
+ * only recycles a segment if it spans more than the current one.
+ */
+static void **defer_segment_get(struct defer_queue *queue)
+{
+	void **seg;
+
+	seg = uatomic_xchg(&queue->spare, NULL);
+	if (seg)
+		return seg;
+	if (uatomic_read(&queue->nr_segments)
+			< CMM_LOAD_SHARED(defer_queue_max_segments)) {
+		seg = defer_segment_alloc();
+		if (seg) {
+			uatomic_inc(&queue->nr_segments);
+			return seg;
+		}
+	}
+	rcu_defer_barrier_thread();
+	seg = uatomic_xchg(&queue->spare, NULL);
+	if (seg)
+		return seg;
+	seg = defer_segment_alloc();
+	if (!seg)
+		urcu_die(ENOMEM);
+	uatomic_inc(&queue->nr_segments);
+	return seg;
+}
+
+/*
+ * Add element head, linking a new segment after the last element of a
+ * segment. The link is published along with head.
+ */
+static void _defer_queue_push(unsigned long *head, void *p)
+{
+	struct defer_queue *queue = &URCU_TLS(defer_queue);
+	void **next;
+
+	_CMM_STORE_SHARED(queue->q[*head & DEFER_QUEUE_MASK], p);
+	if (caa_unlikely((++*head & DEFER_QUEUE_MASK) == 0)) {
+		next = defer_segment_get(queue);
+		_CMM_STORE_SHARED(queue->q[DEFER_QUEUE_SIZE], next);
+		queue->q = next;
+	}
+}
+
 /*
  * _defer_rcu - Queue a RCU callback.
  */
 static void _defer_rcu(void (*fct)(void *p), void *p)
 {
-	unsigned long head, tail;
+	unsigned long head;
 
 	/*
-	 * Head is only modified by ourself. Tail can be modified by reclamation
-	 * thread.
+	 * Head is only modified by ourself. The queue grows by segments
+	 * instead of being emptied when full, up to
+	 * defer_queue_max_segments.
 	 */
 	head = URCU_TLS(defer_queue).head;
-	tail = CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail);
-
-	/*
-	 * If queue is full, or reached threshold. Empty queue ourself.
-	 * Worse-case: must allow 2 supplementary entries for fct pointer.
-	 */
-	if (caa_unlikely(head - tail >= DEFER_QUEUE_SIZE - 2)) {
-		assert(head - tail <= DEFER_QUEUE_SIZE);
-		rcu_defer_barrier_thread();
-		assert(head - CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail) == 0);
-	}
 
 	/*
 	 * Encode:
@@ -342,25 +485,26 @@ static void _defer_rcu(void (*fct)(void *p), void *p)
 			|| p == DQ_FCT_MARK)) {
 		URCU_TLS(defer_queue).last_fct_in = fct;
 		if (caa_unlikely(DQ_IS_FCT_BIT(fct) || fct == DQ_FCT_MARK)) {
-			_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK],
-				      DQ_FCT_MARK);
-			_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK],
-				      fct);
+			_defer_queue_push(&head, DQ_FCT_MARK);
+			_defer_queue_push(&head, fct);
 		} else {
 			DQ_SET_FCT_BIT(fct);
-			_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK],
-				      fct);
+			_defer_queue_push(&head, fct);
 		}
 	}
-	_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK], p);
+	_defer_queue_push(&head, p);
 	cmm_smp_wmb();	/* Publish new pointer before head */
 			/* Write q[] before head. */
 	CMM_STORE_SHARED(URCU_TLS(defer_queue).head, head);
 	cmm_smp_mb();	/* Write queue head before read futex */
 	/*
-	 * Wake-up any waiting defer thread.
+	 * Wake-up any waiting defer thread. Don't let it wait for more
+	 * callbacks once our queue reaches the batch threshold.
 	 */
 	wake_up_defer();
+	if (caa_unlikely(head - CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail)
+			>= CMM_LOAD_SHARED(defer_batch_threshold)))
+		wake_up_defer_batch();
 }
 
 static void *thr_defer(void *args)
@@ -372,8 +516,8 @@ static void *thr_defer(void *args)
 		 * leaving the processor in sleep state when idle.
 		 */
 		wait_defer();
-		/* Sleeping after wait_defer to let many callbacks enqueue */
-		poll(NULL,0,100);	/* wait for 100ms */
+		/* Waiting after wait_defer to let many callbacks enqueue */
+		wait_defer_batch();
 		rcu_defer_barrier();
 	}
 
@@ -389,6 +533,28 @@ void defer_rcu(void (*fct)(void *p), void *p)
 	_defer_rcu(fct, p);
 }
 
+/*
+ * Limit the defer queue of each thread to about nr_entries elements.
+ */
+void rcu_defer_set_queue_limit(unsigned long nr_entries)
+{
+	unsigned long nr_segments;
+
+	/* Segments in use, plus the one being recycled. */
+	nr_segments = (nr_entries + DEFER_QUEUE_SIZE - 1) / DEFER_QUEUE_SIZE + 1;
+	CMM_STORE_SHARED(defer_queue_max_segments, caa_max(nr_segments, 2UL));
+}
+
+/*
+ * Let the defer thread wait up to delay_ms for callbacks to accumulate,
+ * or until a thread queue holds threshold entries.
+ */
+void rcu_defer_set_batch(unsigned long threshold, unsigned long delay_ms)
+{
+	CMM_STORE_SHARED(defer_batch_threshold, threshold);
+	CMM_STORE_SHARED(defer_batch_delay, delay_ms);
+}
+
 static void start_defer_thread(void)
 {
 	int ret;
@@ -406,6 +572,7 @@ static void stop_defer_thread(void)
 	/* Store defer_thread_stop before testing futex */
 	cmm_smp_mb();
 	wake_up_defer();
+	wake_up_defer_batch();
 
 	ret = pthread_join(tid_defer, &tret);
 	assert(!ret);
@@ -421,9 +588,16 @@ int rcu_defer_register_thread(void)
 
 	assert(URCU_TLS(defer_queue).last_head == 0);
 	assert(URCU_TLS(defer_queue).q == NULL);
-	URCU_TLS(defer_queue).q = malloc(sizeof(void *) * DEFER_QUEUE_SIZE);
-	if (!URCU_TLS(defer_queue).q)
+	URCU_TLS(defer_queue).q = defer_segment_alloc();
+	URCU_TLS(defer_queue).spare = defer_segment_alloc();
+	if (!URCU_TLS(defer_queue).q || !URCU_TLS(defer_queue).spare) {
+		free(URCU_TLS(defer_queue).q);
+		free(URCU_TLS(defer_queue).spare);
+		URCU_TLS(defer_queue).q = URCU_TLS(defer_queue).spare = NULL;
 		return -ENOMEM;
+	}
+	URCU_TLS(defer_queue).q_tail = URCU_TLS(defer_queue).q;
+	URCU_TLS(defer_queue).nr_segments = 2;
 
 	mutex_lock_defer(&defer_thread_mutex);
 	mutex_lock_defer(&rcu_defer_mutex);
@@ -445,8 +619,11 @@ void rcu_defer_unregister_thread(void)
 	mutex_lock_defer(&rcu_defer_mutex);
 	cds_list_del(&URCU_TLS(defer_queue).list);
 	_rcu_defer_barrier_thread();
+	/* Empty queue: q_tail is q, and no other segment is in use. */
 	free(URCU_TLS(defer_queue).q);
-	URCU_TLS(defer_queue).q = NULL;
+	free(URCU_TLS(defer_queue).spare);
+	URCU_TLS(defer_queue).q = URCU_TLS(defer_queue).q_tail = NULL;
+	URCU_TLS(defer_queue).spare = NULL;
 	is_empty = cds_list_empty(&registry_defer);
 	mutex_unlock(&rcu_defer_mutex);
 
@@ -60,6 +60,21 @@ extern void rcu_defer_unregister_thread(void);
 extern void rcu_defer_barrier(void);
 extern void rcu_defer_barrier_thread(void);
 
+/*
+ * Limit the defer queue of each thread to about nr_entries elements
+ * (default 126976). Beyond that, defer_rcu() waits for a grace period.
+ */
+extern void rcu_defer_set_queue_limit(unsigned long nr_entries);
+
+/*
+ * The defer thread gives callbacks up to delay_ms (default 100) to
+ * accumulate before waiting for a grace period, unless a thread queue
+ * reaches threshold entries (default 4096). A delay of 0 disables
+ * batching.
+ */
+extern void rcu_defer_set_batch(unsigned long threshold,
+		unsigned long delay_ms);
+
 #ifdef __cplusplus 
 }
 #endif
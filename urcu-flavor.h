@@ -40,6 +40,10 @@ struct rcu_flavor_struct {
 	void (*thread_online)(void);
 	void (*register_thread)(void);
 	void (*unregister_thread)(void);
+
+	unsigned long (*update_get_state_synchronize_rcu)(void);
+	unsigned long (*update_start_poll_synchronize_rcu)(void);
+	int (*update_poll_state_synchronize_rcu)(unsigned long cookie);
 };
 
 #define DEFINE_RCU_FLAVOR(x)				\
@@ -54,6 +58,9 @@ const struct rcu_flavor_struct x = {			\
 	.thread_online		= rcu_thread_online,	\
 	.register_thread	= rcu_register_thread,	\
 	.unregister_thread	= rcu_unregister_thread,\
+	.update_get_state_synchronize_rcu = get_state_synchronize_rcu,	\
+	.update_start_poll_synchronize_rcu = start_poll_synchronize_rcu,\
+	.update_poll_state_synchronize_rcu = poll_state_synchronize_rcu,\
 }
 
 extern const struct rcu_flavor_struct rcu_flavor;
@@ -0,0 +1,160 @@
+#ifndef _URCU_GP_DRIVER_IMPL_H
+#define _URCU_GP_DRIVER_IMPL_H
+
+/*
+ * urcu-gp-driver-impl.h
+ *
+ * Userspace RCU library - grace period driver thread
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Included by each flavor after urcu-poll-impl.h. The including file
+ * provides gp_waiters and lead_grace_period(), which performs one grace
+ * period on behalf of all threads queued in gp_waiters and wakes them
+ * up, as well as the mutex_lock()/mutex_unlock() helpers.
+ *
+ * While the driver runs, synchronize_rcu() only queues itself in
+ * gp_waiters and waits: the driver thread performs grace periods back
+ * to back for as long as gp_waiters is not empty, so concurrent
+ * updaters, call_rcu threads and the defer thread all share them.
+ *
+ * Stopping the driver is ordered against synchronize_rcu() through
+ * rcu_gp_driver_running: a waiter either sees it cleared and performs
+ * the grace period by itself, or is seen in gp_waiters by the driver
+ * before it exits.
+ */
+
+#include <pthread.h>
+#include <urcu/futex.h>
+#include <urcu/uatomic.h>
+
+static pthread_mutex_t rcu_gp_driver_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t rcu_gp_driver_tid;
+static int rcu_gp_driver_running;
+static int rcu_gp_driver_atfork_done;	/* Protected by rcu_gp_driver_lock */
+static int32_t rcu_gp_driver_futex;
+
+/*
+ * Called by synchronize_rcu() once first in gp_waiters. Returns 1 if
+ * the driver will perform the grace period, else 0.
+ */
+static int rcu_gp_driver_wake(void)
+{
+	/* Write gp_waiters before read rcu_gp_driver_running and futex */
+	cmm_smp_mb();
+	if (caa_likely(!CMM_LOAD_SHARED(rcu_gp_driver_running)))
+		return 0;
+	if (uatomic_read(&rcu_gp_driver_futex) == -1) {
+		uatomic_set(&rcu_gp_driver_futex, 0);
+		futex_noasync(&rcu_gp_driver_futex, FUTEX_WAKE, 1,
+			NULL, NULL, 0);
+	}
+	return 1;
+}
+
+static void *rcu_gp_driver_thread(void *arg)
+{
+	int running;
+
+	for (;;) {
+		uatomic_set(&rcu_gp_driver_futex, -1);
+		/* Write futex before read rcu_gp_driver_running */
+		cmm_smp_mb();
+		running = CMM_LOAD_SHARED(rcu_gp_driver_running);
+		/* Read rcu_gp_driver_running before read gp_waiters */
+		cmm_smp_mb();
+		if (!cds_wfs_empty(&gp_waiters.stack)) {
+			uatomic_set(&rcu_gp_driver_futex, 0);
+			lead_grace_period();
+			continue;
+		}
+		if (!running)
+			break;
+		futex_noasync(&rcu_gp_driver_futex, FUTEX_WAIT, -1,
+			NULL, NULL, 0);
+	}
+	return NULL;
+}
+
+/*
+ * The driver thread does not survive fork(): the child performs its
+ * grace periods by itself until it starts its own driver.
+ */
+static void rcu_gp_driver_before_fork(void)
+{
+	mutex_lock(&rcu_gp_driver_lock);
+}
+
+static void rcu_gp_driver_after_fork_parent(void)
+{
+	mutex_unlock(&rcu_gp_driver_lock);
+}
+
+static void rcu_gp_driver_after_fork_child(void)
+{
+	rcu_gp_driver_running = 0;
+	rcu_gp_driver_futex = 0;
+	mutex_unlock(&rcu_gp_driver_lock);
+}
+
+void rcu_gp_driver_start(void)
+{
+	int ret;
+
+	mutex_lock(&rcu_gp_driver_lock);
+	if (rcu_gp_driver_running)
+		goto end;
+	if (!rcu_gp_driver_atfork_done) {
+		ret = pthread_atfork(rcu_gp_driver_before_fork,
+				rcu_gp_driver_after_fork_parent,
+				rcu_gp_driver_after_fork_child);
+		if (ret)
+			urcu_die(ret);
+		rcu_gp_driver_atfork_done = 1;
+	}
+	CMM_STORE_SHARED(rcu_gp_driver_running, 1);
+	ret = pthread_create(&rcu_gp_driver_tid, NULL,
+			rcu_gp_driver_thread, NULL);
+	if (ret)
+		urcu_die(ret);
+end:
+	mutex_unlock(&rcu_gp_driver_lock);
+}
+
+void rcu_gp_driver_stop(void)
+{
+	int ret;
+
+	mutex_lock(&rcu_gp_driver_lock);
+	if (!rcu_gp_driver_running)
+		goto end;
+	CMM_STORE_SHARED(rcu_gp_driver_running, 0);
+	/* Write rcu_gp_driver_running before read futex */
+	cmm_smp_mb();
+	if (uatomic_read(&rcu_gp_driver_futex) == -1) {
+		uatomic_set(&rcu_gp_driver_futex, 0);
+		futex_noasync(&rcu_gp_driver_futex, FUTEX_WAKE, 1,
+			NULL, NULL, 0);
+	}
+	ret = pthread_join(rcu_gp_driver_tid, NULL);
+	if (ret)
+		urcu_die(ret);
+end:
+	mutex_unlock(&rcu_gp_driver_lock);
+}
+
+#endif /* _URCU_GP_DRIVER_IMPL_H */
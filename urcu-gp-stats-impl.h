@@ -0,0 +1,213 @@
+#ifndef _URCU_GP_STATS_IMPL_H
+#define _URCU_GP_STATS_IMPL_H
+
+/*
+ * urcu-gp-stats-impl.h
+ *
+ * Userspace RCU library - grace period statistics and stall detection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Included by each flavor before its grace period code, which calls
+ * the rcu_gp_stats_*() hooks and rcu_gp_stall_*() helpers with
+ * rcu_gp_lock held.
+ *
+ * Statistics are only updated by the grace period leader, with
+ * rcu_gp_lock held: they need neither atomic operations nor per-thread
+ * storage, and stay enabled in all builds. rcu_get_gp_stats() reads
+ * them without rcu_gp_lock, so it never waits for a grace period.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <urcu/system.h>
+
+#include "urcu-gp-stats.h"
+#include "urcu-die.h"
+
+static struct rcu_gp_stats rcu_gp_stats;
+
+/* Current grace period, protected by rcu_gp_lock. */
+static struct timespec rcu_gp_stats_start;
+static unsigned long rcu_gp_stats_scans;
+static unsigned long rcu_gp_stall_timeout_ms;	/* 0: no detection */
+static unsigned long rcu_gp_stall_next_ms;	/* Next report threshold */
+static struct timespec rcu_gp_stall_timeout_ts;	/* Bounds futex waits */
+
+/*
+ * Stall detector configuration. rcu_stall_lock keeps the callback and
+ * its argument consistent. It is only taken to configure the detector
+ * and to report stalls, never on the grace period fast path.
+ */
+static pthread_mutex_t rcu_stall_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long rcu_stall_timeout_ms;
+static void (*rcu_stall_report_cb)(pthread_t tid, unsigned long stall_ms,
+		void *priv);
+static void *rcu_stall_priv;
+
+#define RCU_GP_STATS_INC(field)	\
+	CMM_STORE_SHARED(rcu_gp_stats.field, rcu_gp_stats.field + 1)
+
+static inline void rcu_gp_stats_begin(void)
+{
+	unsigned long timeout_ms;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &rcu_gp_stats_start);
+	rcu_gp_stats_scans = 0;
+	timeout_ms = CMM_LOAD_SHARED(rcu_stall_timeout_ms);
+	if (timeout_ms != rcu_gp_stall_timeout_ms) {
+		rcu_gp_stall_timeout_ms = timeout_ms;
+		rcu_gp_stall_timeout_ts.tv_sec = timeout_ms / 1000;
+		rcu_gp_stall_timeout_ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+	}
+	rcu_gp_stall_next_ms = timeout_ms;
+}
+
+static inline unsigned long rcu_gp_stats_elapsed_us(void)
+{
+	struct timespec now;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - rcu_gp_stats_start.tv_sec) * 1000000UL
+		+ now.tv_nsec / 1000 - rcu_gp_stats_start.tv_nsec / 1000;
+}
+
+static inline void rcu_gp_stats_scan(void)
+{
+	rcu_gp_stats_scans++;
+}
+
+static inline void rcu_gp_stats_futex_wait(void)
+{
+	RCU_GP_STATS_INC(nr_futex_wait);
+}
+
+static inline void rcu_gp_stats_mb_master(void)
+{
+	RCU_GP_STATS_INC(nr_mb_master);
+}
+
+static inline void rcu_gp_stats_end(void)
+{
+	unsigned long us;
+	int i;
+
+	us = rcu_gp_stats_elapsed_us();
+	/* Entry i holds durations of i significant bits. */
+	for (i = 0; us && i < RCU_GP_STATS_HIST_LEN - 1; i++)
+		us >>= 1;
+	RCU_GP_STATS_INC(duration_hist[i]);
+
+	CMM_STORE_SHARED(rcu_gp_stats.nr_scans,
+		rcu_gp_stats.nr_scans + rcu_gp_stats_scans);
+	if (rcu_gp_stats_scans > rcu_gp_stats.max_scans)
+		CMM_STORE_SHARED(rcu_gp_stats.max_scans, rcu_gp_stats_scans);
+	RCU_GP_STATS_INC(nr_gp);
+}
+
+/*
+ * Timeout for the grace period futex wait: a stalled reader never wakes
+ * us up, so we must wake up by ourself to report it. NULL when stall
+ * detection is disabled.
+ */
+static inline const struct timespec *rcu_gp_stall_wait_timeout(void)
+{
+	if (!rcu_gp_stall_timeout_ms)
+		return NULL;
+	return &rcu_gp_stall_timeout_ts;
+}
+
+/*
+ * Called while waiting for readers, after the active waiting attempts.
+ * Returns the time elapsed since the grace period began, in ms, if the
+ * pending readers should be reported with rcu_gp_stall_report(), else
+ * 0.
+ */
+static inline unsigned long rcu_gp_stall_check(void)
+{
+	unsigned long elapsed_ms;
+
+	if (caa_likely(!rcu_gp_stall_next_ms))
+		return 0;
+	elapsed_ms = rcu_gp_stats_elapsed_us() / 1000;
+	if (elapsed_ms < rcu_gp_stall_next_ms)
+		return 0;
+	while (rcu_gp_stall_next_ms <= elapsed_ms)
+		rcu_gp_stall_next_ms += rcu_gp_stall_timeout_ms;
+	return elapsed_ms;
+}
+
+static void rcu_stall_lock_acquire(void)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&rcu_stall_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void rcu_stall_lock_release(void)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(&rcu_stall_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void rcu_gp_stall_report(pthread_t tid, unsigned long stall_ms)
+{
+	RCU_GP_STATS_INC(nr_stalls);
+	rcu_stall_lock_acquire();
+	if (rcu_stall_report_cb)
+		rcu_stall_report_cb(tid, stall_ms, rcu_stall_priv);
+	else
+		fprintf(stderr, "[liburcu] grace period stalled for %lu ms "
+			"by reader thread 0x%lx\n", stall_ms,
+			(unsigned long) tid);
+	rcu_stall_lock_release();
+}
+
+void rcu_set_stall_detector(unsigned long timeout_ms,
+		void (*report)(pthread_t tid, unsigned long stall_ms,
+			void *priv),
+		void *priv)
+{
+	rcu_stall_lock_acquire();
+	rcu_stall_report_cb = report;
+	rcu_stall_priv = priv;
+	CMM_STORE_SHARED(rcu_stall_timeout_ms, timeout_ms);
+	rcu_stall_lock_release();
+}
+
+void rcu_get_gp_stats(struct rcu_gp_stats *stats)
+{
+	int i;
+
+	stats->nr_gp = CMM_LOAD_SHARED(rcu_gp_stats.nr_gp);
+	for (i = 0; i < RCU_GP_STATS_HIST_LEN; i++)
+		stats->duration_hist[i] =
+			CMM_LOAD_SHARED(rcu_gp_stats.duration_hist[i]);
+	stats->nr_scans = CMM_LOAD_SHARED(rcu_gp_stats.nr_scans);
+	stats->max_scans = CMM_LOAD_SHARED(rcu_gp_stats.max_scans);
+	stats->nr_futex_wait = CMM_LOAD_SHARED(rcu_gp_stats.nr_futex_wait);
+	stats->nr_mb_master = CMM_LOAD_SHARED(rcu_gp_stats.nr_mb_master);
+	stats->nr_stalls = CMM_LOAD_SHARED(rcu_gp_stats.nr_stalls);
+}
+
+#endif /* _URCU_GP_STATS_IMPL_H */
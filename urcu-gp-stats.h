@@ -0,0 +1,76 @@
+#ifndef _URCU_GP_STATS_H
+#define _URCU_GP_STATS_H
+
+/*
+ * urcu-gp-stats.h
+ *
+ * Userspace RCU header - grace period statistics and stall detection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RCU_GP_STATS_HIST_LEN	24
+
+/*
+ * Counters are cumulative since the library was loaded.
+ */
+struct rcu_gp_stats {
+	unsigned long nr_gp;		/* Grace periods completed */
+	/*
+	 * Grace period duration histogram. Entry 0 counts grace periods
+	 * shorter than 1us, entry i those lasting [2^(i-1), 2^i) us, and
+	 * the last entry all the longer ones.
+	 */
+	unsigned long duration_hist[RCU_GP_STATS_HIST_LEN];
+	unsigned long nr_scans;		/* Reader registry scans */
+	unsigned long max_scans;	/* Most scans within a grace period */
+	unsigned long nr_futex_wait;	/* Sleeps waiting for readers */
+	unsigned long nr_mb_master;	/* smp_mb_master()/signal broadcasts */
+	unsigned long nr_stalls;	/* Stalled readers reported */
+};
+
+/*
+ * Copy the statistics of the flavor into "stats". Does not wait for
+ * ongoing grace periods, so counters are read one by one: the copy may
+ * straddle the end of a grace period.
+ */
+extern void rcu_get_gp_stats(struct rcu_gp_stats *stats);
+
+/*
+ * Reader stall detection, disabled by default. Once a grace period has
+ * waited for "timeout_ms" milliseconds, each reader thread still
+ * holding it up is reported with the time elapsed since the grace
+ * period began, and again every "timeout_ms" milliseconds until the
+ * grace period completes. "report" is called from the thread
+ * performing the grace period, with "priv" as last argument. It must
+ * not call into RCU. A NULL "report" prints to stderr. A zero
+ * "timeout_ms" disables detection.
+ */
+extern void rcu_set_stall_detector(unsigned long timeout_ms,
+		void (*report)(pthread_t tid, unsigned long stall_ms,
+			void *priv),
+		void *priv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_GP_STATS_H */
@@ -0,0 +1,104 @@
+#ifndef _URCU_POLL_IMPL_H
+#define _URCU_POLL_IMPL_H
+
+/*
+ * urcu-poll-impl.h
+ *
+ * Userspace RCU library - Polled grace period API
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Included by each flavor after urcu-call-rcu-impl.h. The including
+ * file provides rcu_gp_seq, which synchronize_rcu() makes odd when a
+ * grace period begins and even when it completes, as well as the
+ * mutex_lock()/mutex_unlock() helpers.
+ *
+ * A cookie is the value rcu_gp_seq will reach once a full grace period
+ * beginning after the cookie was taken has completed. Cookies are
+ * compared modulo ULONG_MAX, which tolerates wrap-around as long as
+ * a cookie is not kept for more than ULONG_MAX / 4 grace periods.
+ */
+
+#define RCU_GP_SEQ_CMP_GE(a, b)	((long) ((a) - (b)) >= 0)
+
+/*
+ * rcu_gp_poll_lock protects the polling worker state. It is only held
+ * for short periods, never across a grace period.
+ */
+static pthread_mutex_t rcu_gp_poll_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_head rcu_gp_poll_head;
+static unsigned long rcu_gp_poll_target;	/* Latest requested cookie */
+static int rcu_gp_poll_pending;		/* rcu_gp_poll_head is queued */
+
+unsigned long get_state_synchronize_rcu(void)
+{
+	unsigned long seq;
+
+	/* Order prior updates before reading the sequence. */
+	cmm_smp_mb();
+	seq = CMM_LOAD_SHARED(rcu_gp_seq);
+	/*
+	 * If a grace period is in progress (odd), it may have started
+	 * before our updates: wait for the one following it.
+	 */
+	return (seq + 3) & ~1UL;
+}
+
+int poll_state_synchronize_rcu(unsigned long cookie)
+{
+	int ret;
+
+	ret = RCU_GP_SEQ_CMP_GE(CMM_LOAD_SHARED(rcu_gp_seq), cookie);
+	/* Order reading the sequence before following reclamation. */
+	cmm_smp_mb();
+	return ret;
+}
+
+/*
+ * Runs from a call_rcu worker once a grace period has elapsed since it
+ * was queued. Requeue ourself until the latest requested cookie is
+ * reached, so a request made while our grace period was already in
+ * progress is not left behind.
+ */
+static void rcu_gp_poll_cb(struct rcu_head *head)
+{
+	mutex_lock(&rcu_gp_poll_lock);
+	if (poll_state_synchronize_rcu(rcu_gp_poll_target))
+		rcu_gp_poll_pending = 0;
+	else
+		call_rcu(head, rcu_gp_poll_cb);
+	mutex_unlock(&rcu_gp_poll_lock);
+}
+
+unsigned long start_poll_synchronize_rcu(void)
+{
+	unsigned long cookie;
+
+	cookie = get_state_synchronize_rcu();
+	mutex_lock(&rcu_gp_poll_lock);
+	if (!rcu_gp_poll_pending
+			|| !RCU_GP_SEQ_CMP_GE(rcu_gp_poll_target, cookie))
+		rcu_gp_poll_target = cookie;
+	if (!rcu_gp_poll_pending) {
+		rcu_gp_poll_pending = 1;
+		call_rcu(&rcu_gp_poll_head, rcu_gp_poll_cb);
+	}
+	mutex_unlock(&rcu_gp_poll_lock);
+	return cookie;
+}
+
+#endif /* _URCU_POLL_IMPL_H */
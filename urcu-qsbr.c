@@ -35,6 +35,13 @@
 #include <errno.h>
 #include <poll.h>
 
+#include "config.h"
+
+#ifdef RCU_QSBR_TREE
+/* Grace periods do not scan the readers: no registry array needed. */
+#undef CONFIG_RCU_REGISTRY_ARRAY
+#endif
+
 #include "urcu/wfcqueue.h"
 #include "urcu/map/urcu-qsbr.h"
 #define BUILD_QSBR_LIB
@@ -43,6 +50,9 @@
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-registry.h"
+#include "urcu-gp-stats-impl.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -78,6 +88,36 @@ DEFINE_URCU_TLS(unsigned int, rcu_rand_yield);
 
 static CDS_LIST_HEAD(registry);
 
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+/* Registered reader counters, scanned by update_counter_and_wait(). */
+static DEFINE_RCU_REGISTRY_ARRAY(registry_array);
+#endif
+
+#ifndef RCU_QSBR_TREE
+/*
+ * Readers registered since the last grace period began. Pushed to by
+ * rcu_register_thread() without holding rcu_gp_lock, and merged into
+ * the registry with rcu_gp_lock held.
+ */
+static DEFINE_RCU_REGISTRY_PENDING(registry_pending);
+#endif
+
+/*
+ * Grace period sequence counter, used by the polled grace period API.
+ * Odd while a grace period is in progress. Written to only by the
+ * grace period leader with rcu_gp_lock held.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/* Grace period driver thread, see urcu-gp-driver-impl.h. */
+static int rcu_gp_driver_wake(void);
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
 	int ret;
@@ -111,16 +151,266 @@ static void wait_gp(void)
 {
 	/* Read reader_gp before read futex */
 	cmm_smp_rmb();
-	if (uatomic_read(&rcu_gp_futex) == -1)
+	if (uatomic_read(&rcu_gp_futex) == -1) {
+		rcu_gp_stats_futex_wait();
 		futex_noasync(&rcu_gp_futex, FUTEX_WAIT, -1,
-		      NULL, NULL, 0);
+		      rcu_gp_stall_wait_timeout(), NULL, 0);
+	}
+}
+
+#ifdef RCU_QSBR_TREE
+
+/*
+ * Leaf nodes, allocated as readers register and never freed. The array
+ * only grows with rcu_gp_lock held, which grace periods hold while
+ * walking it.
+ */
+static struct rcu_qs_node **rcu_qs_nodes;
+static size_t rcu_qs_nr_nodes, rcu_qs_alloc_nodes;
+
+/*
+ * Number of leaf nodes with readers the current grace period waits for.
+ */
+static long rcu_qs_root_pending;
+
+#define RCU_QS_NODE_FULL_MASK	((1UL << RCU_QSBR_TREE_FANOUT) - 1)
+
+static struct rcu_qs_node *rcu_qs_node_alloc(void)
+{
+	struct rcu_qs_node *qs_node;
+	int ret;
+
+	ret = posix_memalign((void **) &qs_node, CAA_CACHE_LINE_SIZE,
+			sizeof(*qs_node));
+	if (ret)
+		urcu_die(ret);
+	memset(qs_node, 0, sizeof(*qs_node));
+	ret = pthread_mutex_init(&qs_node->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return qs_node;
+}
+
+/*
+ * Assign the current thread a free bit in a leaf node. Called with
+ * rcu_gp_lock held.
+ */
+static void rcu_qs_node_assign(void)
+{
+	struct rcu_qs_node *qs_node = NULL;
+	size_t i;
+
+	for (i = 0; i < rcu_qs_nr_nodes; i++) {
+		if (rcu_qs_nodes[i]->used_mask != RCU_QS_NODE_FULL_MASK) {
+			qs_node = rcu_qs_nodes[i];
+			break;
+		}
+	}
+	if (!qs_node) {
+		if (rcu_qs_nr_nodes == rcu_qs_alloc_nodes) {
+			size_t new_alloc;
+			struct rcu_qs_node **new_nodes;
+
+			new_alloc = caa_max(rcu_qs_alloc_nodes << 1, (size_t) 4);
+			new_nodes = realloc(rcu_qs_nodes,
+					new_alloc * sizeof(*new_nodes));
+			if (!new_nodes)
+				urcu_die(ENOMEM);
+			rcu_qs_nodes = new_nodes;
+			rcu_qs_alloc_nodes = new_alloc;
+		}
+		qs_node = rcu_qs_node_alloc();
+		rcu_qs_nodes[rcu_qs_nr_nodes++] = qs_node;
+	}
+	URCU_TLS(rcu_reader).qs_node = qs_node;
+	/* Lowest clear bit. */
+	URCU_TLS(rcu_reader).qs_mask = ~qs_node->used_mask & (qs_node->used_mask + 1);
+	qs_node->used_mask |= URCU_TLS(rcu_reader).qs_mask;
+}
+
+/*
+ * Called with rcu_gp_lock held, once the thread is offline.
+ */
+static void rcu_qs_node_release(void)
+{
+	URCU_TLS(rcu_reader).qs_node->used_mask &= ~URCU_TLS(rcu_reader).qs_mask;
+	URCU_TLS(rcu_reader).qs_node = NULL;
+	URCU_TLS(rcu_reader).qs_mask = 0;
+}
+
+/*
+ * Clear a reader bit from the current grace period. The last reader of
+ * the last pending leaf wakes up synchronize_rcu(). Called with the
+ * leaf lock held.
+ */
+static void rcu_qs_node_clear(struct rcu_qs_node *qs_node, unsigned long mask)
+{
+	unsigned long qsmask;
+
+	qsmask = qs_node->qsmask & ~mask;
+	CMM_STORE_SHARED(qs_node->qsmask, qsmask);
+	if (qsmask || uatomic_add_return(&rcu_qs_root_pending, -1) != 0)
+		return;
+	/* Write rcu_qs_root_pending before read futex */
+	cmm_smp_mb();
+	if (uatomic_read(&rcu_gp_futex) != -1)
+		return;
+	uatomic_set(&rcu_gp_futex, 0);
+	futex_noasync(&rcu_gp_futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/*
+ * Report the readers holding up the current grace period, if it has
+ * been stalled for long enough. Called with rcu_gp_lock held.
+ */
+static void report_stalled_readers(void)
+{
+	struct rcu_reader *index;
+	unsigned long stall_ms;
+
+	stall_ms = rcu_gp_stall_check();
+	if (caa_likely(!stall_ms))
+		return;
+	cds_list_for_each_entry(index, &registry, node) {
+		if (CMM_LOAD_SHARED(index->qs_node->qsmask) & index->qs_mask)
+			rcu_gp_stall_report(index->tid, stall_ms);
+	}
+}
+
+/*
+ * Only count a quiescent state if it was observed with the counter of
+ * the grace period waiting for it: a reader may have loaded rcu_gp_ctr
+ * just before it was updated.
+ */
+void rcu_qs_report(void)
+{
+	struct rcu_qs_node *qs_node = URCU_TLS(rcu_reader).qs_node;
+	unsigned long mask = URCU_TLS(rcu_reader).qs_mask;
+
+	mutex_lock(&qs_node->lock);
+	if ((qs_node->qsmask & mask)
+			&& URCU_TLS(rcu_reader).ctr == qs_node->gp_ctr)
+		rcu_qs_node_clear(qs_node, mask);
+	mutex_unlock(&qs_node->lock);
+}
+
+void rcu_qs_thread_offline(void)
+{
+	struct rcu_qs_node *qs_node = URCU_TLS(rcu_reader).qs_node;
+	unsigned long mask = URCU_TLS(rcu_reader).qs_mask;
+
+	mutex_lock(&qs_node->lock);
+	qs_node->online_mask &= ~mask;
+	if (qs_node->qsmask & mask)
+		rcu_qs_node_clear(qs_node, mask);
+	mutex_unlock(&qs_node->lock);
+}
+
+/*
+ * A thread coming online after update_counter_and_wait() initialized its
+ * leaf is not waited for by the current grace period. Acquiring the leaf
+ * lock orders its following read-side critical sections after the
+ * beginning of the grace period.
+ */
+void rcu_qs_thread_online(void)
+{
+	struct rcu_qs_node *qs_node = URCU_TLS(rcu_reader).qs_node;
+
+	mutex_lock(&qs_node->lock);
+	qs_node->online_mask |= URCU_TLS(rcu_reader).qs_mask;
+	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, CMM_LOAD_SHARED(rcu_gp_ctr));
+	mutex_unlock(&qs_node->lock);
 }
 
 static void update_counter_and_wait(void)
 {
-	CDS_LIST_HEAD(qsreaders);
+	unsigned long new_gp_ctr;
 	int wait_loops = 0;
-	struct rcu_reader *index, *tmp;
+	size_t i;
+
+#if (CAA_BITS_PER_LONG < 64)
+	/* Switch parity: 0 -> 1, 1 -> 0 */
+	new_gp_ctr = rcu_gp_ctr ^ RCU_GP_CTR;
+#else	/* !(CAA_BITS_PER_LONG < 64) */
+	/* Increment current G.P. */
+	new_gp_ctr = rcu_gp_ctr + RCU_GP_CTR;
+#endif	/* !(CAA_BITS_PER_LONG < 64) */
+
+	/*
+	 * Mark the online readers of each leaf as pending before
+	 * publishing the new counter, so that quiescent states reported
+	 * with it find their bit set.
+	 */
+	for (i = 0; i < rcu_qs_nr_nodes; i++) {
+		struct rcu_qs_node *qs_node = rcu_qs_nodes[i];
+
+		mutex_lock(&qs_node->lock);
+		qs_node->gp_ctr = new_gp_ctr;
+		CMM_STORE_SHARED(qs_node->qsmask, qs_node->online_mask);
+		if (qs_node->online_mask)
+			uatomic_inc(&rcu_qs_root_pending);
+		mutex_unlock(&qs_node->lock);
+	}
+
+	/* Write qsmask before write rcu_gp_ctr */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(rcu_gp_ctr, new_gp_ctr);
+	/* Write rcu_gp_ctr before read rcu_qs_root_pending */
+	cmm_smp_mb();
+
+	/*
+	 * Wait for the root count of pending leaves to become 0.
+	 */
+	while (uatomic_read(&rcu_qs_root_pending)) {
+		rcu_gp_stats_scan();
+		if (++wait_loops < RCU_QS_ACTIVE_ATTEMPTS) {
+			caa_cpu_relax();
+			continue;
+		}
+		uatomic_set(&rcu_gp_futex, -1);
+		/* Write futex before read rcu_qs_root_pending */
+		cmm_smp_mb();
+		if (!uatomic_read(&rcu_qs_root_pending)) {
+			uatomic_set(&rcu_gp_futex, 0);
+			break;
+		}
+		report_stalled_readers();
+		wait_gp();
+	}
+	/* Read rcu_qs_root_pending before following reclamation. */
+	cmm_smp_mb();
+}
+
+#else /* #ifdef RCU_QSBR_TREE */
+
+/*
+ * Report the readers holding up the current grace period, if it has
+ * been stalled for long enough. Called with rcu_gp_lock held.
+ */
+static void report_stalled_readers(void)
+{
+	struct rcu_reader *index;
+	unsigned long stall_ms;
+
+	stall_ms = rcu_gp_stall_check();
+	if (caa_likely(!stall_ms))
+		return;
+	cds_list_for_each_entry(index, &registry, node) {
+		if (rcu_gp_ongoing(&index->ctr))
+			rcu_gp_stall_report(index->tid, stall_ms);
+	}
+}
+
+static void update_counter_and_wait(void)
+{
+	int wait_loops = 0, pending;
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+	size_t nr_pending = registry_array.len;
+#else
+	CDS_LIST_HEAD(qsreaders);
+	struct rcu_reader *tmp;
+#endif
+	struct rcu_reader *index;
 
 #if (CAA_BITS_PER_LONG < 64)
 	/* Switch parity: 0 -> 1, 1 -> 0 */
@@ -164,12 +454,20 @@ static void update_counter_and_wait(void)
 			/* Write futex before read reader_gp */
 			cmm_smp_mb();
 		}
+		rcu_gp_stats_scan();
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+		nr_pending = rcu_registry_array_scan(&registry_array,
+				nr_pending, rcu_gp_ongoing);
+		pending = nr_pending != 0;
+#else
 		cds_list_for_each_entry_safe(index, tmp, &registry, node) {
 			if (!rcu_gp_ongoing(&index->ctr))
 				cds_list_move(&index->node, &qsreaders);
 		}
+		pending = !cds_list_empty(&registry);
+#endif
 
-		if (cds_list_empty(&registry)) {
+		if (!pending) {
 			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
 				/* Read reader_gp before write futex */
 				cmm_smp_mb();
@@ -178,6 +476,7 @@ static void update_counter_and_wait(void)
 			break;
 		} else {
 			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
+				report_stalled_readers();
 				wait_gp();
 			} else {
 #ifndef HAS_INCOHERENT_CACHES
@@ -188,9 +487,44 @@ static void update_counter_and_wait(void)
 			}
 		}
 	}
+#ifndef CONFIG_RCU_REGISTRY_ARRAY
 	/* put back the reader list in the registry */
 	cds_list_splice(&qsreaders, &registry);
+#endif
+}
+
+#endif /* #else #ifdef RCU_QSBR_TREE */
+
+#ifdef RCU_QSBR_TREE
+/*
+ * Tree readers register with rcu_gp_lock held, which assigning them a
+ * leaf requires: none is ever pending.
+ */
+static void merge_registry_pending(void)
+{
+}
+#else /* #ifdef RCU_QSBR_TREE */
+/*
+ * Move the readers of registry_pending into the registry. Called with
+ * rcu_gp_lock held.
+ */
+static void merge_registry_pending(void)
+{
+	struct cds_wfs_head *head;
+	struct cds_wfs_node *iter, *iter_n;
+
+	head = __cds_wfs_pop_all(&registry_pending);
+	cds_wfs_for_each_blocking_safe(head, iter, iter_n) {
+		struct rcu_reader *reader =
+			caa_container_of(iter, struct rcu_reader, pending);
+
+		cds_list_add(&reader->node, &registry);
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+		rcu_registry_array_add(&registry_array, &reader->ctr);
+#endif
+	}
 }
+#endif /* #else #ifdef RCU_QSBR_TREE */
 
 /*
  * Using a two-subphases algorithm for architectures with smaller than 64-bit
@@ -198,26 +532,23 @@ static void update_counter_and_wait(void)
  */
 
 #if (CAA_BITS_PER_LONG < 64)
-void synchronize_rcu(void)
+/*
+ * Perform a grace period. Called with rcu_gp_lock held.
+ */
+static void wait_grace_period(void)
 {
-	unsigned long was_online;
-
-	was_online = URCU_TLS(rcu_reader).ctr;
+	rcu_gp_stats_begin();
+	/* Grace period begins: make the sequence odd. */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	cmm_smp_mb();
 
-	/* All threads should read qparity before accessing data structure
-	 * where new ptr points to.  In the "then" case, rcu_thread_offline
-	 * includes a memory barrier.
-	 *
-	 * Mark the writer thread offline to make sure we don't wait for
-	 * our own quiescent state. This allows using synchronize_rcu()
-	 * in threads registered as readers.
+	/*
+	 * Readers registering after this point pair the memory barrier
+	 * implied by cds_wfs_push() with ours above: their read-side
+	 * critical sections see the updates which preceded this grace
+	 * period, which does not need to wait for them.
 	 */
-	if (was_online)
-		rcu_thread_offline();
-	else
-		cmm_smp_mb();
-
-	mutex_lock(&rcu_gp_lock);
+	merge_registry_pending();
 
 	if (cds_list_empty(&registry))
 		goto out;
@@ -249,25 +580,72 @@ void synchronize_rcu(void)
 	 */
 	update_counter_and_wait();	/* 1 -> 0, wait readers in parity 1 */
 out:
-	mutex_unlock(&rcu_gp_lock);
+	/* Grace period completed: make the sequence even. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	rcu_gp_stats_end();
+}
+#else /* !(CAA_BITS_PER_LONG < 64) */
+/*
+ * Perform a grace period. Called with rcu_gp_lock held.
+ */
+static void wait_grace_period(void)
+{
+	rcu_gp_stats_begin();
+	/* Grace period begins: make the sequence odd. */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	cmm_smp_mb();
 
 	/*
-	 * Finish waiting for reader threads before letting the old ptr being
-	 * freed.
+	 * Readers registering after this point pair the memory barrier
+	 * implied by cds_wfs_push() with ours above: their read-side
+	 * critical sections see the updates which preceded this grace
+	 * period, which does not need to wait for them.
 	 */
-	if (was_online)
-		rcu_thread_online();
-	else
-		cmm_smp_mb();
+	merge_registry_pending();
+
+	if (cds_list_empty(&registry))
+		goto out;
+	update_counter_and_wait();
+out:
+	/* Grace period completed: make the sequence even. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	rcu_gp_stats_end();
 }
-#else /* !(CAA_BITS_PER_LONG < 64) */
+#endif  /* !(CAA_BITS_PER_LONG < 64) */
+
+/*
+ * Perform a grace period on behalf of all threads queued in gp_waiters,
+ * and wake them up.
+ */
+static void lead_grace_period(void)
+{
+	struct urcu_waiters waiters;
+
+	mutex_lock(&rcu_gp_lock);
+
+	/*
+	 * Move all waiters into our local queue.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	wait_grace_period();
+	mutex_unlock(&rcu_gp_lock);
+	urcu_wake_all_waiters(&waiters);
+}
+
 void synchronize_rcu(void)
 {
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
 	unsigned long was_online;
 
 	was_online = URCU_TLS(rcu_reader).ctr;
 
-	/*
+	/* All threads should read qparity before accessing data structure
+	 * where new ptr points to.  In the "then" case, rcu_thread_offline
+	 * includes a memory barrier.
+	 *
 	 * Mark the writer thread offline to make sure we don't wait for
 	 * our own quiescent state. This allows using synchronize_rcu()
 	 * in threads registered as readers.
@@ -277,19 +655,32 @@ void synchronize_rcu(void)
 	else
 		cmm_smp_mb();
 
-	mutex_lock(&rcu_gp_lock);
-	if (cds_list_empty(&registry))
-		goto out;
-	update_counter_and_wait();
-out:
-	mutex_unlock(&rcu_gp_lock);
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue, and the
+	 * grace period driver thread is not running.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0
+			|| rcu_gp_driver_wake()) {
+		/* Will be awakened by another thread. */
+		urcu_adaptative_busy_wait(&wait);
+		goto gp_end;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
 
+	lead_grace_period();
+gp_end:
+	/*
+	 * Finish waiting for reader threads before letting the old ptr being
+	 * freed.
+	 */
 	if (was_online)
 		rcu_thread_online();
 	else
 		cmm_smp_mb();
 }
-#endif  /* !(CAA_BITS_PER_LONG < 64) */
 
 /*
  * library wrappers to be used by non-LGPL compatible source code.
@@ -320,6 +711,7 @@ void rcu_thread_online(void)
 	_rcu_thread_online();
 }
 
+#ifdef RCU_QSBR_TREE
 void rcu_register_thread(void)
 {
 	URCU_TLS(rcu_reader).tid = pthread_self();
@@ -327,9 +719,29 @@ void rcu_register_thread(void)
 
 	mutex_lock(&rcu_gp_lock);
 	cds_list_add(&URCU_TLS(rcu_reader).node, &registry);
+	rcu_qs_node_assign();
 	mutex_unlock(&rcu_gp_lock);
 	_rcu_thread_online();
 }
+#else /* #ifdef RCU_QSBR_TREE */
+/*
+ * Registration does not take rcu_gp_lock, so it never waits for a grace
+ * period in progress: see registry_pending.
+ */
+void rcu_register_thread(void)
+{
+	URCU_TLS(rcu_reader).tid = pthread_self();
+	assert(URCU_TLS(rcu_reader).ctr == 0);
+
+	/*
+	 * The full memory barrier implied by cds_wfs_push() orders it
+	 * before going online.
+	 */
+	cds_wfs_node_init(&URCU_TLS(rcu_reader).pending);
+	cds_wfs_push(&registry_pending, &URCU_TLS(rcu_reader).pending);
+	_rcu_thread_online();
+}
+#endif /* #else #ifdef RCU_QSBR_TREE */
 
 void rcu_unregister_thread(void)
 {
@@ -339,7 +751,15 @@ void rcu_unregister_thread(void)
 	 */
 	_rcu_thread_offline();
 	mutex_lock(&rcu_gp_lock);
+	/* Our registration may still be pending. */
+	merge_registry_pending();
 	cds_list_del(&URCU_TLS(rcu_reader).node);
+#ifdef RCU_QSBR_TREE
+	rcu_qs_node_release();
+#endif
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+	rcu_registry_array_del(&registry_array, &URCU_TLS(rcu_reader).ctr);
+#endif
 	mutex_unlock(&rcu_gp_lock);
 }
 
@@ -356,3 +776,19 @@ DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
+#include "urcu-gp-driver-impl.h"
+
+#ifndef RCU_QSBR_TREE
+/*
+ * Earlier releases of liburcu-qsbr exported free_all_cpu_call_rcu_data()
+ * without the _qsbr suffix. Keep that symbol for binaries linked against
+ * them.
+ */
+#undef free_all_cpu_call_rcu_data
+void free_all_cpu_call_rcu_data(void);
+void free_all_cpu_call_rcu_data(void)
+{
+	free_all_cpu_call_rcu_data_qsbr();
+}
+#endif
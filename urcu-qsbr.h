@@ -68,12 +68,21 @@ extern "C" {
  * DON'T FORGET TO USE rcu_register_thread/rcu_unregister_thread()
  * FOR EACH THREAD WITH READ-SIDE CRITICAL SECTION.
  */
+#ifdef RCU_QSBR_TREE
+#define rcu_read_lock_qsbr_tree		_rcu_read_lock
+#define rcu_read_unlock_qsbr_tree	_rcu_read_unlock
+
+#define rcu_quiescent_state_qsbr_tree	_rcu_quiescent_state
+#define rcu_thread_offline_qsbr_tree	_rcu_thread_offline
+#define rcu_thread_online_qsbr_tree	_rcu_thread_online
+#else
 #define rcu_read_lock_qsbr		_rcu_read_lock
 #define rcu_read_unlock_qsbr		_rcu_read_unlock
 
 #define rcu_quiescent_state_qsbr	_rcu_quiescent_state
 #define rcu_thread_offline_qsbr		_rcu_thread_offline
 #define rcu_thread_online_qsbr		_rcu_thread_online
+#endif
 
 #else /* !_LGPL_SOURCE */
 
@@ -115,6 +124,27 @@ extern void rcu_thread_online(void);
 
 extern void synchronize_rcu(void);
 
+/*
+ * Polled grace periods. get_state_synchronize_rcu() returns a cookie
+ * which poll_state_synchronize_rcu() reports as completed (non-zero)
+ * once a full grace period has elapsed since the cookie was taken.
+ * start_poll_synchronize_rcu() also makes sure such a grace period
+ * will be started, without blocking the caller.
+ */
+extern unsigned long get_state_synchronize_rcu(void);
+extern unsigned long start_poll_synchronize_rcu(void);
+extern int poll_state_synchronize_rcu(unsigned long cookie);
+
+/*
+ * Grace period driver. Between rcu_gp_driver_start() and
+ * rcu_gp_driver_stop(), a dedicated thread performs grace periods back
+ * to back while synchronize_rcu() callers (including call_rcu and defer
+ * threads) are waiting, so they all share the same grace periods
+ * instead of each performing its own.
+ */
+extern void rcu_gp_driver_start(void);
+extern void rcu_gp_driver_stop(void);
+
 /*
  * Reader thread registration.
  */
@@ -127,6 +157,7 @@ extern void rcu_unregister_thread(void);
 
 #include <urcu-call-rcu.h>
 #include <urcu-defer.h>
+#include <urcu-gp-stats.h>
 #include <urcu-flavor.h>
 
 #endif /* _URCU_QSBR_H */
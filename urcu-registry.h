@@ -0,0 +1,133 @@
+#ifndef _URCU_REGISTRY_H
+#define _URCU_REGISTRY_H
+
+/*
+ * urcu-registry.h
+ *
+ * Userspace RCU library - dense reader registry array
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * With --enable-registry-array, grace periods scan an array of pointers
+ * to the reader counters instead of walking the registry list.
+ *
+ * The counters themselves stay in each reader's thread-local,
+ * cache-line aligned struct rcu_reader: packing them would make readers
+ * of different threads write to the same cache lines. The array only
+ * turns the scan into independent loads from contiguous memory, which
+ * the CPU can overlap and which we prefetch ahead, rather than a chain
+ * of dependent cache misses through the list nodes.
+ *
+ * The array is only accessed with rcu_gp_lock held.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <urcu/compiler.h>
+#include <urcu/wfstack.h>
+
+#include "urcu-die.h"
+
+/*
+ * rcu_register_thread() pushes the reader onto a wait-free stack of
+ * pending registrations rather than taking rcu_gp_lock, which grace
+ * periods hold throughout: thread startup never waits for a grace
+ * period. Each grace period begins by moving the pending readers into
+ * the registry, with rcu_gp_lock held.
+ */
+#define DEFINE_RCU_REGISTRY_PENDING(name)	\
+	struct cds_wfs_stack name =		\
+		{ .head = CDS_WFS_END, .lock = PTHREAD_MUTEX_INITIALIZER }
+
+/* Number of entries prefetched ahead of the scan. */
+#define RCU_REGISTRY_PREFETCH	8
+
+#define RCU_REGISTRY_MIN_ALLOC	16
+
+struct rcu_registry_array {
+	unsigned long **ctrs;	/* Points to each rcu_reader ctr */
+	size_t len;		/* Registered readers */
+	size_t alloc_len;
+};
+
+#define DEFINE_RCU_REGISTRY_ARRAY(name)		\
+	struct rcu_registry_array name = { NULL, 0, 0 }
+
+static inline
+void rcu_registry_array_add(struct rcu_registry_array *array,
+		unsigned long *ctr)
+{
+	if (array->len == array->alloc_len) {
+		size_t new_len;
+		unsigned long **new_ctrs;
+
+		new_len = caa_max(array->alloc_len << 1,
+				(size_t) RCU_REGISTRY_MIN_ALLOC);
+		new_ctrs = realloc(array->ctrs, new_len * sizeof(*new_ctrs));
+		if (!new_ctrs)
+			urcu_die(ENOMEM);
+		array->ctrs = new_ctrs;
+		array->alloc_len = new_len;
+	}
+	array->ctrs[array->len++] = ctr;
+}
+
+static inline
+void rcu_registry_array_del(struct rcu_registry_array *array,
+		unsigned long *ctr)
+{
+	size_t i;
+
+	for (i = 0; i < array->len; i++) {
+		if (array->ctrs[i] != ctr)
+			continue;
+		array->ctrs[i] = array->ctrs[--array->len];
+		return;
+	}
+	urcu_die(EINVAL);
+}
+
+/*
+ * Scan the first nr_pending entries, moving those for which
+ * gp_ongoing() is false past the end of the pending range. Entry order
+ * is not preserved. Returns the number of readers still pending.
+ */
+static inline
+size_t rcu_registry_array_scan(struct rcu_registry_array *array,
+		size_t nr_pending, int (*gp_ongoing)(unsigned long *ctr))
+{
+	unsigned long **ctrs = array->ctrs;
+	size_t i = 0;
+
+	while (i < nr_pending) {
+		unsigned long *ctr;
+
+		if (i + RCU_REGISTRY_PREFETCH < nr_pending)
+			__builtin_prefetch(ctrs[i + RCU_REGISTRY_PREFETCH]);
+		if (gp_ongoing(ctrs[i])) {
+			i++;
+			continue;
+		}
+		/* Quiescent: swap with the last pending entry. */
+		ctr = ctrs[i];
+		ctrs[i] = ctrs[--nr_pending];
+		ctrs[nr_pending] = ctr;
+	}
+	return nr_pending;
+}
+
+#endif /* _URCU_REGISTRY_H */
@@ -35,6 +35,9 @@
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
+#include <sched.h>
+
+#include "config.h"
 
 #include "urcu/wfcqueue.h"
 #include "urcu/map/urcu.h"
@@ -43,6 +46,9 @@
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-registry.h"
+#include "urcu-gp-stats-impl.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -62,6 +68,32 @@
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
 #ifdef RCU_MEMBARRIER
+#ifdef __linux__
+#include <syscall.h>
+#endif
+
+/* Commands of the membarrier() system call (Linux 4.14+). */
+enum membarrier_cmd {
+	MEMBARRIER_CMD_QUERY				= 0,
+	MEMBARRIER_CMD_SHARED				= (1 << 0),
+	MEMBARRIER_CMD_PRIVATE_EXPEDITED		= (1 << 3),
+	MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	= (1 << 4),
+};
+
+/*
+ * Headers lacking __NR_membarrier and non-Linux systems get ENOSYS,
+ * which makes rcu_init() fall back on cmm_smp_mb() at runtime.
+ */
+static int membarrier(int cmd, int flags)
+{
+#ifdef __NR_membarrier
+	return syscall(__NR_membarrier, cmd, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 static int init_done;
 int rcu_has_sys_membarrier;
 
@@ -106,6 +138,34 @@ DEFINE_URCU_TLS(unsigned int, rcu_rand_yield);
 
 static CDS_LIST_HEAD(registry);
 
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+/* Registered reader counters, scanned by update_counter_and_wait(). */
+static DEFINE_RCU_REGISTRY_ARRAY(registry_array);
+#endif
+
+/*
+ * Readers registered since the last grace period began. Pushed to by
+ * rcu_register_thread() without holding rcu_gp_lock, and merged into
+ * the registry with rcu_gp_lock held.
+ */
+static DEFINE_RCU_REGISTRY_PENDING(registry_pending);
+
+/*
+ * Grace period sequence counter, used by the polled grace period API.
+ * Odd while a grace period is in progress. Written to only by the
+ * grace period leader with rcu_gp_lock held.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/* Grace period driver thread, see urcu-gp-driver-impl.h. */
+static int rcu_gp_driver_wake(void);
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
 	int ret;
@@ -140,16 +200,20 @@ static void mutex_unlock(pthread_mutex_t *mutex)
 #ifdef RCU_MEMBARRIER
 static void smp_mb_master(int group)
 {
-	if (caa_likely(rcu_has_sys_membarrier))
-		membarrier(MEMBARRIER_EXPEDITED);
-	else
+	rcu_gp_stats_mb_master();
+	if (caa_likely(rcu_has_sys_membarrier)) {
+		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0))
+			urcu_die(errno);
+	} else {
 		cmm_smp_mb();
+	}
 }
 #endif
 
 #ifdef RCU_MB
 static void smp_mb_master(int group)
 {
+	rcu_gp_stats_mb_master();
 	cmm_smp_mb();
 }
 #endif
@@ -199,10 +263,29 @@ static void force_mb_all_readers(void)
 
 static void smp_mb_master(int group)
 {
+	rcu_gp_stats_mb_master();
 	force_mb_all_readers();
 }
 #endif /* #ifdef RCU_SIGNAL */
 
+/*
+ * Report the readers holding up the current grace period, if it has
+ * been stalled for long enough. Called with rcu_gp_lock held.
+ */
+static void report_stalled_readers(void)
+{
+	struct rcu_reader *index;
+	unsigned long stall_ms;
+
+	stall_ms = rcu_gp_stall_check();
+	if (caa_likely(!stall_ms))
+		return;
+	cds_list_for_each_entry(index, &registry, node) {
+		if (rcu_gp_ongoing(&index->ctr))
+			rcu_gp_stall_report(index->tid, stall_ms);
+	}
+}
+
 /*
  * synchronize_rcu() waiting. Single thread.
  */
@@ -210,16 +293,28 @@ static void wait_gp(void)
 {
 	/* Read reader_gp before read futex */
 	smp_mb_master(RCU_MB_GROUP);
-	if (uatomic_read(&rcu_gp_futex) == -1)
+	if (uatomic_read(&rcu_gp_futex) == -1) {
+		rcu_gp_stats_futex_wait();
 		futex_async(&rcu_gp_futex, FUTEX_WAIT, -1,
-		      NULL, NULL, 0);
+		      rcu_gp_stall_wait_timeout(), NULL, 0);
+	}
 }
 
-static void update_counter_and_wait(void)
+/*
+ * Expedited grace periods never sleep on rcu_gp_futex, so they are not
+ * delayed by a futex wakeup round-trip. Past RCU_QS_ACTIVE_ATTEMPTS,
+ * they yield the CPU between scans so a preempted reader sharing our
+ * CPU can make progress.
+ */
+static void update_counter_and_wait(int expedited)
 {
+	int wait_loops = 0, pending;
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+	size_t nr_pending = registry_array.len;
+#else
 	CDS_LIST_HEAD(qsreaders);
-	int wait_loops = 0;
 	struct rcu_reader *index, *tmp;
+#endif
 
 	/* Switch parity: 0 -> 1, 1 -> 0 */
 	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR_PHASE);
@@ -244,31 +339,59 @@ static void update_counter_and_wait(void)
 	 * Wait for each thread URCU_TLS(rcu_reader).ctr count to become 0.
 	 */
 	for (;;) {
+#ifndef HAS_INCOHERENT_CACHES
+		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS)
+			wait_loops++;
+		/*
+		 * Arm the futex again before each wait: the previous
+		 * wait_gp() may have been woken up by a reader, or have
+		 * timed out for the stall detector.
+		 */
+		if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS && !expedited) {
+#else /* #ifndef HAS_INCOHERENT_CACHES */
 		wait_loops++;
-		if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
-			uatomic_dec(&rcu_gp_futex);
+		if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS && !expedited) {
+#endif /* #else #ifndef HAS_INCOHERENT_CACHES */
+			uatomic_set(&rcu_gp_futex, -1);
 			/* Write futex before read reader_gp */
 			smp_mb_master(RCU_MB_GROUP);
 		}
 
+		rcu_gp_stats_scan();
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+		nr_pending = rcu_registry_array_scan(&registry_array,
+				nr_pending, rcu_gp_ongoing);
+		pending = nr_pending != 0;
+#else
 		cds_list_for_each_entry_safe(index, tmp, &registry, node) {
 			if (!rcu_gp_ongoing(&index->ctr))
 				cds_list_move(&index->node, &qsreaders);
 		}
+		pending = !cds_list_empty(&registry);
+#endif
+		if (pending && wait_loops >= RCU_QS_ACTIVE_ATTEMPTS)
+			report_stalled_readers();
 
 #ifndef HAS_INCOHERENT_CACHES
-		if (cds_list_empty(&registry)) {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
+		if (!pending) {
+			/*
+			 * rcu_gp_futex is still armed if no reader woke
+			 * us up since we last armed it.
+			 */
+			if (uatomic_read(&rcu_gp_futex) != 0) {
 				/* Read reader_gp before write futex */
 				smp_mb_master(RCU_MB_GROUP);
 				uatomic_set(&rcu_gp_futex, 0);
 			}
 			break;
 		} else {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS)
-				wait_gp();
-			else
+			if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS) {
 				caa_cpu_relax();
+			} else if (expedited) {
+				sched_yield();
+			} else {
+				wait_gp();
+			}
 		}
 #else /* #ifndef HAS_INCOHERENT_CACHES */
 		/*
@@ -276,8 +399,12 @@ static void update_counter_and_wait(void)
 		 * URCU_TLS(rcu_reader).ctr update to memory if we wait
 		 * for too long.
 		 */
-		if (cds_list_empty(&registry)) {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
+		if (!pending) {
+			/*
+			 * rcu_gp_futex is still armed if no reader woke
+			 * us up since we last armed it.
+			 */
+			if (uatomic_read(&rcu_gp_futex) != 0) {
 				/* Read reader_gp before write futex */
 				smp_mb_master(RCU_MB_GROUP);
 				uatomic_set(&rcu_gp_futex, 0);
@@ -286,25 +413,67 @@ static void update_counter_and_wait(void)
 		} else {
 			switch (wait_loops) {
 			case RCU_QS_ACTIVE_ATTEMPTS:
-				wait_gp();
+				if (!expedited)
+					wait_gp();
 				break; /* only escape switch */
 			case KICK_READER_LOOPS:
 				smp_mb_master(RCU_MB_GROUP);
 				wait_loops = 0;
 				break; /* only escape switch */
 			default:
-				caa_cpu_relax();
+				if (expedited && wait_loops > RCU_QS_ACTIVE_ATTEMPTS) {
+					sched_yield();
+				} else {
+					caa_cpu_relax();
+				}
 			}
 		}
 #endif /* #else #ifndef HAS_INCOHERENT_CACHES */
 	}
+#ifndef CONFIG_RCU_REGISTRY_ARRAY
 	/* put back the reader list in the registry */
 	cds_list_splice(&qsreaders, &registry);
+#endif
 }
 
-void synchronize_rcu(void)
+/*
+ * Move the readers of registry_pending into the registry. Called with
+ * rcu_gp_lock held.
+ */
+static void merge_registry_pending(void)
 {
-	mutex_lock(&rcu_gp_lock);
+	struct cds_wfs_head *head;
+	struct cds_wfs_node *iter, *iter_n;
+
+	head = __cds_wfs_pop_all(&registry_pending);
+	cds_wfs_for_each_blocking_safe(head, iter, iter_n) {
+		struct rcu_reader *reader =
+			caa_container_of(iter, struct rcu_reader, pending);
+
+		cds_list_add(&reader->node, &registry);
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+		rcu_registry_array_add(&registry_array, &reader->ctr);
+#endif
+	}
+}
+
+/*
+ * Perform a grace period. Called with rcu_gp_lock held.
+ */
+static void wait_grace_period(int expedited)
+{
+	rcu_gp_stats_begin();
+	/* Grace period begins: make the sequence odd. */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	cmm_smp_mb();
+
+	/*
+	 * Readers registering after this point pair the memory barrier
+	 * implied by cds_wfs_push() with ours above: their read-side
+	 * critical sections see the updates which preceded this grace
+	 * period, which does not need to wait for them.
+	 */
+	merge_registry_pending();
 
 	if (cds_list_empty(&registry))
 		goto out;
@@ -318,7 +487,7 @@ void synchronize_rcu(void)
 	/*
 	 * Wait for previous parity to be empty of readers.
 	 */
-	update_counter_and_wait();	/* 0 -> 1, wait readers in parity 0 */
+	update_counter_and_wait(expedited);	/* 0 -> 1, wait readers in parity 0 */
 
 	/*
 	 * Must finish waiting for quiescent state for parity 0 before
@@ -339,13 +508,84 @@ void synchronize_rcu(void)
 	/*
 	 * Wait for previous parity to be empty of readers.
 	 */
-	update_counter_and_wait();	/* 1 -> 0, wait readers in parity 1 */
+	update_counter_and_wait(expedited);	/* 1 -> 0, wait readers in parity 1 */
 
 	/* Finish waiting for reader threads before letting the old ptr being
 	 * freed. Must be done within rcu_gp_lock because it iterates on reader
 	 * threads. */
 	smp_mb_master(RCU_MB_GROUP);
 out:
+	/* Grace period completed: make the sequence even. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	rcu_gp_stats_end();
+}
+
+/*
+ * Perform a grace period on behalf of all threads queued in gp_waiters,
+ * and wake them up.
+ */
+static void lead_grace_period(void)
+{
+	struct urcu_waiters waiters;
+
+	mutex_lock(&rcu_gp_lock);
+
+	/*
+	 * Move all waiters into our local queue. The grace period we
+	 * are about to perform starts after they were queued, so it
+	 * covers all of them.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	wait_grace_period(0);
+	mutex_unlock(&rcu_gp_lock);
+
+	/*
+	 * Wakeup waiters only after we have completed the grace period
+	 * and have ensured the memory barriers at the end of the grace
+	 * period have been issued.
+	 */
+	urcu_wake_all_waiters(&waiters);
+}
+
+void synchronize_rcu(void)
+{
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue, and the
+	 * grace period driver thread is not running.
+	 * The implicit memory barrier before urcu_wait_add()
+	 * orders prior memory accesses of threads put into the wait
+	 * queue before their insertion into the wait queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0
+			|| rcu_gp_driver_wake()) {
+		/* Will be awakened by another thread. */
+		urcu_adaptative_busy_wait(&wait);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		return;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
+	lead_grace_period();
+}
+
+void synchronize_rcu_expedited(void)
+{
+	/*
+	 * Do not join gp_waiters: a shared grace period is run by its
+	 * leader in normal mode, sleeping on rcu_gp_futex, whereas this
+	 * one busy-waits. The barriers within wait_grace_period() order
+	 * prior and following memory accesses.
+	 */
+	mutex_lock(&rcu_gp_lock);
+	wait_grace_period(1);
 	mutex_unlock(&rcu_gp_lock);
 }
 
@@ -363,33 +603,59 @@ void rcu_read_unlock(void)
 	_rcu_read_unlock();
 }
 
+/*
+ * Registration does not take rcu_gp_lock, so it never waits for a grace
+ * period in progress: see registry_pending.
+ */
 void rcu_register_thread(void)
 {
 	URCU_TLS(rcu_reader).tid = pthread_self();
 	assert(URCU_TLS(rcu_reader).need_mb == 0);
 	assert(!(URCU_TLS(rcu_reader).ctr & RCU_GP_CTR_NEST_MASK));
 
-	mutex_lock(&rcu_gp_lock);
-	rcu_init();	/* In case gcc does not support constructor attribute */
-	cds_list_add(&URCU_TLS(rcu_reader).node, &registry);
-	mutex_unlock(&rcu_gp_lock);
+#ifndef RCU_MB
+	/* In case gcc does not support constructor attribute */
+	if (caa_unlikely(!CMM_LOAD_SHARED(init_done))) {
+		mutex_lock(&rcu_gp_lock);
+		rcu_init();
+		mutex_unlock(&rcu_gp_lock);
+	}
+#endif
+	/*
+	 * The full memory barrier implied by cds_wfs_push() orders it
+	 * before our following read-side critical sections.
+	 */
+	cds_wfs_node_init(&URCU_TLS(rcu_reader).pending);
+	cds_wfs_push(&registry_pending, &URCU_TLS(rcu_reader).pending);
 }
 
 void rcu_unregister_thread(void)
 {
 	mutex_lock(&rcu_gp_lock);
+	/* Our registration may still be pending. */
+	merge_registry_pending();
 	cds_list_del(&URCU_TLS(rcu_reader).node);
+#ifdef CONFIG_RCU_REGISTRY_ARRAY
+	rcu_registry_array_del(&registry_array, &URCU_TLS(rcu_reader).ctr);
+#endif
 	mutex_unlock(&rcu_gp_lock);
 }
 
 #ifdef RCU_MEMBARRIER
 void rcu_init(void)
 {
+	int ret;
+
 	if (init_done)
 		return;
-	init_done = 1;
-	if (!membarrier(MEMBARRIER_EXPEDITED | MEMBARRIER_QUERY))
+	ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	/* Private expedited commands require registration (Linux 4.14+). */
+	if (ret >= 0 && (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+			&& !membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0))
 		rcu_has_sys_membarrier = 1;
+	/* Initialize before rcu_register_thread() reads init_done. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(init_done, 1);
 }
 #endif
 
@@ -408,7 +674,7 @@ static void sigrcu_handler(int signo, siginfo_t *siginfo, void *context)
 
 /*
  * rcu_init constructor. Called when the library is linked, but also when
- * reader threads are calling rcu_register_thread().
+ * reader threads are calling rcu_register_thread() before it completed.
  * Should only be called by a single thread at a given time. This is ensured by
  * holing the rcu_gp_lock from rcu_register_thread() or by running at library
  * load time, which should not be executed by multiple threads nor concurrently
@@ -421,7 +687,6 @@ void rcu_init(void)
 
 	if (init_done)
 		return;
-	init_done = 1;
 
 	act.sa_sigaction = sigrcu_handler;
 	act.sa_flags = SA_SIGINFO | SA_RESTART;
@@ -429,6 +694,9 @@ void rcu_init(void)
 	ret = sigaction(SIGRCU, &act, NULL);
 	if (ret)
 		urcu_die(errno);
+	/* Initialize before rcu_register_thread() reads init_done. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(init_done, 1);
 }
 
 void rcu_exit(void)
@@ -449,3 +717,5 @@ DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
+#include "urcu-gp-driver-impl.h"
@@ -96,6 +96,35 @@ extern void rcu_read_unlock(void);
 
 extern void synchronize_rcu(void);
 
+/*
+ * synchronize_rcu_expedited() waits for a grace period like
+ * synchronize_rcu(), but busy-waits for readers instead of sleeping,
+ * and does not share its grace period with concurrent callers. It
+ * trades updater CPU time for lower grace period latency.
+ */
+extern void synchronize_rcu_expedited(void);
+
+/*
+ * Polled grace periods. get_state_synchronize_rcu() returns a cookie
+ * which poll_state_synchronize_rcu() reports as completed (non-zero)
+ * once a full grace period has elapsed since the cookie was taken.
+ * start_poll_synchronize_rcu() also makes sure such a grace period
+ * will be started, without blocking the caller.
+ */
+extern unsigned long get_state_synchronize_rcu(void);
+extern unsigned long start_poll_synchronize_rcu(void);
+extern int poll_state_synchronize_rcu(unsigned long cookie);
+
+/*
+ * Grace period driver. Between rcu_gp_driver_start() and
+ * rcu_gp_driver_stop(), a dedicated thread performs grace periods back
+ * to back while synchronize_rcu() callers (including call_rcu and defer
+ * threads) are waiting, so they all share the same grace periods
+ * instead of each performing its own.
+ */
+extern void rcu_gp_driver_start(void);
+extern void rcu_gp_driver_stop(void);
+
 /*
  * Reader thread registration.
  */
@@ -128,6 +157,7 @@ static inline void rcu_thread_online(void)
 
 #include <urcu-call-rcu.h>
 #include <urcu-defer.h>
+#include <urcu-gp-stats.h>
 #include <urcu-flavor.h>
 
 #endif /* _URCU_H */
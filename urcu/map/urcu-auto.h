@@ -0,0 +1,75 @@
+#ifndef _URCU_AUTO_MAP_H
+#define _URCU_AUTO_MAP_H
+
+/*
+ * urcu/map/urcu-auto.h
+ *
+ * Userspace RCU header -- name mapping to allow multiple flavors to be
+ * used in the same executable.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Mapping macros to allow multiple flavors in a single binary. */
+
+#define rcu_read_lock			rcu_read_lock_auto
+#define rcu_read_unlock			rcu_read_unlock_auto
+#define rcu_register_thread		rcu_register_thread_auto
+#define rcu_unregister_thread		rcu_unregister_thread_auto
+#define rcu_init			rcu_init_auto
+#define synchronize_rcu			synchronize_rcu_auto
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_auto
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_auto
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_auto
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_auto
+#define rcu_get_gp_stats		rcu_get_gp_stats_auto
+#define rcu_set_stall_detector		rcu_set_stall_detector_auto
+#define rcu_gp_driver_start		rcu_gp_driver_start_auto
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_auto
+
+#define get_cpu_call_rcu_data		get_cpu_call_rcu_data_auto
+#define get_call_rcu_thread		get_call_rcu_thread_auto
+#define create_call_rcu_data		create_call_rcu_data_auto
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_auto
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_auto
+#define call_rcu_run_ready		call_rcu_run_ready_auto
+#define set_cpu_call_rcu_data		set_cpu_call_rcu_data_auto
+#define get_default_call_rcu_data	get_default_call_rcu_data_auto
+#define get_call_rcu_data		get_call_rcu_data_auto
+#define get_thread_call_rcu_data	get_thread_call_rcu_data_auto
+#define set_thread_call_rcu_data	set_thread_call_rcu_data_auto
+#define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_auto
+#define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_auto
+#define call_rcu			call_rcu_auto
+#define call_rcu_bulk			call_rcu_bulk_auto
+#define free_rcu_head			free_rcu_head_auto
+#define call_rcu_data_free		call_rcu_data_free_auto
+#define rcu_barrier			rcu_barrier_auto
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_auto
+#define call_rcu_before_fork		call_rcu_before_fork_auto
+#define call_rcu_after_fork_parent	call_rcu_after_fork_parent_auto
+#define call_rcu_after_fork_child	call_rcu_after_fork_child_auto
+
+#define defer_rcu			defer_rcu_auto
+#define rcu_defer_register_thread	rcu_defer_register_thread_auto
+#define rcu_defer_unregister_thread	rcu_defer_unregister_thread_auto
+#define rcu_defer_barrier		rcu_defer_barrier_auto
+#define rcu_defer_barrier_thread	rcu_defer_barrier_thread_auto
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_auto
+#define rcu_defer_set_batch		rcu_defer_set_batch_auto
+
+#define rcu_flavor			rcu_flavor_auto
+
+#endif /* _URCU_AUTO_MAP_H */
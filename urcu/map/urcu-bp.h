@@ -38,11 +38,19 @@
 #define _rcu_read_lock			_rcu_read_lock_bp
 #define rcu_read_unlock			rcu_read_unlock_bp
 #define _rcu_read_unlock		_rcu_read_unlock_bp
+#define _rcu_read_ongoing		_rcu_read_ongoing_bp
 #define rcu_register_thread		rcu_register_thread_bp
 #define rcu_unregister_thread		rcu_unregister_thread_bp
 #define rcu_init			rcu_init_bp
 #define rcu_exit			rcu_exit_bp
 #define synchronize_rcu			synchronize_rcu_bp
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_bp
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_bp
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_bp
+#define rcu_get_gp_stats		rcu_get_gp_stats_bp
+#define rcu_set_stall_detector		rcu_set_stall_detector_bp
+#define rcu_gp_driver_start		rcu_gp_driver_start_bp
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_bp
 #define rcu_reader			rcu_reader_bp
 #define rcu_gp_ctr			rcu_gp_ctr_bp
 #define rcu_gp_futex			rcu_gp_futex_bp	/* unused */
@@ -50,6 +58,9 @@
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_bp
 #define get_call_rcu_thread		get_call_rcu_thread_bp
 #define create_call_rcu_data		create_call_rcu_data_bp
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_bp
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_bp
+#define call_rcu_run_ready		call_rcu_run_ready_bp
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_bp
 #define get_default_call_rcu_data	get_default_call_rcu_data_bp
 #define get_call_rcu_data		get_call_rcu_data_bp
@@ -58,7 +69,11 @@
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_bp
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_bp
 #define call_rcu			call_rcu_bp
+#define call_rcu_bulk			call_rcu_bulk_bp
+#define free_rcu_head			free_rcu_head_bp
 #define call_rcu_data_free		call_rcu_data_free_bp
+#define rcu_barrier			rcu_barrier_bp
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_bp
 #define call_rcu_before_fork		call_rcu_before_fork_bp
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_bp
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_bp
@@ -68,6 +83,8 @@
 #define rcu_defer_unregister_thread	rcu_defer_unregister_thread_bp
 #define rcu_defer_barrier		rcu_defer_barrier_bp
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_bp
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_bp
+#define rcu_defer_set_batch		rcu_defer_set_batch_bp
 #define rcu_defer_exit			rcu_defer_exit_bp
 
 #define rcu_flavor			rcu_flavor_bp
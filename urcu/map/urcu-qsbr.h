@@ -34,10 +34,79 @@
 
 /* Mapping macros to allow multiple flavors in a single binary. */
 
+#ifdef RCU_QSBR_TREE
+
+#define rcu_read_lock			rcu_read_lock_qsbr_tree
+#define _rcu_read_lock			_rcu_read_lock_qsbr_tree
+#define rcu_read_unlock			rcu_read_unlock_qsbr_tree
+#define _rcu_read_unlock		_rcu_read_unlock_qsbr_tree
+#define _rcu_read_ongoing		_rcu_read_ongoing_qsbr_tree
+#define rcu_quiescent_state		rcu_quiescent_state_qsbr_tree
+#define _rcu_quiescent_state		_rcu_quiescent_state_qsbr_tree
+#define rcu_thread_offline		rcu_thread_offline_qsbr_tree
+#define rcu_thread_online		rcu_thread_online_qsbr_tree
+#define rcu_register_thread		rcu_register_thread_qsbr_tree
+#define rcu_unregister_thread		rcu_unregister_thread_qsbr_tree
+#define rcu_exit			rcu_exit_qsbr_tree
+#define synchronize_rcu			synchronize_rcu_qsbr_tree
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_qsbr_tree
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_qsbr_tree
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_qsbr_tree
+#define rcu_get_gp_stats		rcu_get_gp_stats_qsbr_tree
+#define rcu_set_stall_detector		rcu_set_stall_detector_qsbr_tree
+#define rcu_gp_driver_start		rcu_gp_driver_start_qsbr_tree
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_qsbr_tree
+#define rcu_reader			rcu_reader_qsbr_tree
+#define rcu_gp_ctr			rcu_gp_ctr_qsbr_tree
+#define rcu_gp_futex			rcu_gp_futex_qsbr_tree
+#define rcu_qs_report			rcu_qs_report_qsbr_tree
+#define rcu_qs_thread_offline		rcu_qs_thread_offline_qsbr_tree
+#define rcu_qs_thread_online		rcu_qs_thread_online_qsbr_tree
+
+#define get_cpu_call_rcu_data		get_cpu_call_rcu_data_qsbr_tree
+#define get_call_rcu_thread		get_call_rcu_thread_qsbr_tree
+#define create_call_rcu_data		create_call_rcu_data_qsbr_tree
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_qsbr_tree
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_qsbr_tree
+#define call_rcu_run_ready		call_rcu_run_ready_qsbr_tree
+#define set_cpu_call_rcu_data		set_cpu_call_rcu_data_qsbr_tree
+#define get_default_call_rcu_data	get_default_call_rcu_data_qsbr_tree
+#define get_call_rcu_data		get_call_rcu_data_qsbr_tree
+#define get_thread_call_rcu_data	get_thread_call_rcu_data_qsbr_tree
+#define set_thread_call_rcu_data	set_thread_call_rcu_data_qsbr_tree
+#define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_qsbr_tree
+#define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_qsbr_tree
+#define call_rcu			call_rcu_qsbr_tree
+#define call_rcu_bulk			call_rcu_bulk_qsbr_tree
+#define free_rcu_head			free_rcu_head_qsbr_tree
+#define call_rcu_data_free		call_rcu_data_free_qsbr_tree
+#define rcu_barrier			rcu_barrier_qsbr_tree
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_qsbr_tree
+#define call_rcu_before_fork		call_rcu_before_fork_qsbr_tree
+#define call_rcu_after_fork_parent	call_rcu_after_fork_parent_qsbr_tree
+#define call_rcu_after_fork_child	call_rcu_after_fork_child_qsbr_tree
+
+#define defer_rcu			defer_rcu_qsbr_tree
+#define rcu_defer_register_thread	rcu_defer_register_thread_qsbr_tree
+#define rcu_defer_unregister_thread	rcu_defer_unregister_thread_qsbr_tree
+#define	rcu_defer_barrier		rcu_defer_barrier_qsbr_tree
+#define rcu_defer_barrier_thread	rcu_defer_barrier_thread_qsbr_tree
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_qsbr_tree
+#define rcu_defer_set_batch		rcu_defer_set_batch_qsbr_tree
+#define rcu_defer_exit			rcu_defer_exit_qsbr_tree
+
+#define rcu_flavor			rcu_flavor_qsbr_tree
+
+#define rcu_yield_active		rcu_yield_active_qsbr_tree
+#define rcu_rand_yield			rcu_rand_yield_qsbr_tree
+
+#else /* #ifdef RCU_QSBR_TREE */
+
 #define rcu_read_lock			rcu_read_lock_qsbr
 #define _rcu_read_lock			_rcu_read_lock_qsbr
 #define rcu_read_unlock			rcu_read_unlock_qsbr
 #define _rcu_read_unlock		_rcu_read_unlock_qsbr
+#define _rcu_read_ongoing		_rcu_read_ongoing_qsbr
 #define rcu_quiescent_state		rcu_quiescent_state_qsbr
 #define _rcu_quiescent_state		_rcu_quiescent_state_qsbr
 #define rcu_thread_offline		rcu_thread_offline_qsbr
@@ -46,6 +115,13 @@
 #define rcu_unregister_thread		rcu_unregister_thread_qsbr
 #define rcu_exit			rcu_exit_qsbr
 #define synchronize_rcu			synchronize_rcu_qsbr
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_qsbr
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_qsbr
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_qsbr
+#define rcu_get_gp_stats		rcu_get_gp_stats_qsbr
+#define rcu_set_stall_detector		rcu_set_stall_detector_qsbr
+#define rcu_gp_driver_start		rcu_gp_driver_start_qsbr
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_qsbr
 #define rcu_reader			rcu_reader_qsbr
 #define rcu_gp_ctr			rcu_gp_ctr_qsbr
 #define rcu_gp_futex			rcu_gp_futex_qsbr
@@ -53,14 +129,22 @@
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_qsbr
 #define get_call_rcu_thread		get_call_rcu_thread_qsbr
 #define create_call_rcu_data		create_call_rcu_data_qsbr
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_qsbr
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_qsbr
+#define call_rcu_run_ready		call_rcu_run_ready_qsbr
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_qsbr
 #define get_default_call_rcu_data	get_default_call_rcu_data_qsbr
 #define get_call_rcu_data		get_call_rcu_data_qsbr
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_qsbr
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_qsbr
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_qsbr
+#define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_qsbr
 #define call_rcu			call_rcu_qsbr
+#define call_rcu_bulk			call_rcu_bulk_qsbr
+#define free_rcu_head			free_rcu_head_qsbr
 #define call_rcu_data_free		call_rcu_data_free_qsbr
+#define rcu_barrier			rcu_barrier_qsbr
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_qsbr
 #define call_rcu_before_fork		call_rcu_before_fork_qsbr
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_qsbr
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_qsbr
@@ -70,6 +154,8 @@
 #define rcu_defer_unregister_thread	rcu_defer_unregister_thread_qsbr
 #define	rcu_defer_barrier		rcu_defer_barrier_qsbr
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_qsbr
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_qsbr
+#define rcu_defer_set_batch		rcu_defer_set_batch_qsbr
 #define rcu_defer_exit			rcu_defer_exit_qsbr
 
 #define rcu_flavor			rcu_flavor_qsbr
@@ -77,4 +163,6 @@
 #define rcu_yield_active		rcu_yield_active_memb_qsbr
 #define rcu_rand_yield			rcu_rand_yield_memb_qsbr
 
+#endif /* #else #ifdef RCU_QSBR_TREE */
+
 #endif /* _URCU_QSBR_MAP_H */
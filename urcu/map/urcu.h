@@ -38,42 +38,26 @@
 #define RCU_MEMBARRIER
 #endif
 
-/*
- * RCU_MEMBARRIER is only possibly available on Linux. Fallback to
- * RCU_MB
- * otherwise.
- */
-#if !defined(__linux__) && defined(RCU_MEMBARRIER)
-#undef RCU_MEMBARRIER
-#define RCU_MB
-#endif
-
-#ifdef RCU_MEMBARRIER
-#include <syscall.h>
-
-/* If the headers do not support SYS_membarrier, statically use RCU_MB */
-#ifdef SYS_membarrier
-# define MEMBARRIER_EXPEDITED		(1 << 0)
-# define MEMBARRIER_DELAYED		(1 << 1)
-# define MEMBARRIER_QUERY		(1 << 16)
-# define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
-#else
-# undef RCU_MEMBARRIER
-# define RCU_MB
-#endif
-#endif
-
 #ifdef RCU_MEMBARRIER
 
 #define rcu_read_lock			rcu_read_lock_memb
 #define _rcu_read_lock			_rcu_read_lock_memb
 #define rcu_read_unlock			rcu_read_unlock_memb
 #define _rcu_read_unlock		_rcu_read_unlock_memb
+#define _rcu_read_ongoing		_rcu_read_ongoing_memb
 #define rcu_register_thread		rcu_register_thread_memb
 #define rcu_unregister_thread		rcu_unregister_thread_memb
 #define rcu_init			rcu_init_memb
 #define rcu_exit			rcu_exit_memb
 #define synchronize_rcu			synchronize_rcu_memb
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_memb
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_memb
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_memb
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_memb
+#define rcu_get_gp_stats		rcu_get_gp_stats_memb
+#define rcu_set_stall_detector		rcu_set_stall_detector_memb
+#define rcu_gp_driver_start		rcu_gp_driver_start_memb
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_memb
 #define rcu_reader			rcu_reader_memb
 #define rcu_gp_ctr			rcu_gp_ctr_memb
 #define rcu_gp_futex			rcu_gp_futex_memb
@@ -81,6 +65,9 @@
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_memb
 #define get_call_rcu_thread		get_call_rcu_thread_memb
 #define create_call_rcu_data		create_call_rcu_data_memb
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_memb
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_memb
+#define call_rcu_run_ready		call_rcu_run_ready_memb
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_memb
 #define get_default_call_rcu_data	get_default_call_rcu_data_memb
 #define get_call_rcu_data		get_call_rcu_data_memb
@@ -89,7 +76,11 @@
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_memb
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_memb
 #define call_rcu			call_rcu_memb
+#define call_rcu_bulk			call_rcu_bulk_memb
+#define free_rcu_head			free_rcu_head_memb
 #define call_rcu_data_free		call_rcu_data_free_memb
+#define rcu_barrier			rcu_barrier_memb
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_memb
 #define call_rcu_before_fork		call_rcu_before_fork_memb
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_memb
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_memb
@@ -99,6 +90,8 @@
 #define rcu_defer_unregister_thread	rcu_defer_unregister_thread_memb
 #define rcu_defer_barrier		rcu_defer_barrier_memb
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_memb
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_memb
+#define rcu_defer_set_batch		rcu_defer_set_batch_memb
 #define rcu_defer_exit			rcu_defer_exit_memb
 
 #define rcu_flavor			rcu_flavor_memb
@@ -115,11 +108,20 @@
 #define _rcu_read_lock			_rcu_read_lock_sig
 #define rcu_read_unlock			rcu_read_unlock_sig
 #define _rcu_read_unlock		_rcu_read_unlock_sig
+#define _rcu_read_ongoing		_rcu_read_ongoing_sig
 #define rcu_register_thread		rcu_register_thread_sig
 #define rcu_unregister_thread		rcu_unregister_thread_sig
 #define rcu_init			rcu_init_sig
 #define rcu_exit			rcu_exit_sig
 #define synchronize_rcu			synchronize_rcu_sig
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_sig
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_sig
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_sig
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_sig
+#define rcu_get_gp_stats		rcu_get_gp_stats_sig
+#define rcu_set_stall_detector		rcu_set_stall_detector_sig
+#define rcu_gp_driver_start		rcu_gp_driver_start_sig
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_sig
 #define rcu_reader			rcu_reader_sig
 #define rcu_gp_ctr			rcu_gp_ctr_sig
 #define rcu_gp_futex			rcu_gp_futex_sig
@@ -127,6 +129,9 @@
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_sig
 #define get_call_rcu_thread		get_call_rcu_thread_sig
 #define create_call_rcu_data		create_call_rcu_data_sig
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_sig
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_sig
+#define call_rcu_run_ready		call_rcu_run_ready_sig
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_sig
 #define get_default_call_rcu_data	get_default_call_rcu_data_sig
 #define get_call_rcu_data		get_call_rcu_data_sig
@@ -135,7 +140,11 @@
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_sig
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_sig
 #define call_rcu			call_rcu_sig
+#define call_rcu_bulk			call_rcu_bulk_sig
+#define free_rcu_head			free_rcu_head_sig
 #define call_rcu_data_free		call_rcu_data_free_sig
+#define rcu_barrier			rcu_barrier_sig
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_sig
 #define call_rcu_before_fork		call_rcu_before_fork_sig
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_sig
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_sig
@@ -145,6 +154,8 @@
 #define rcu_defer_unregister_thread	rcu_defer_unregister_thread_sig
 #define rcu_defer_barrier		rcu_defer_barrier_sig
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_sig
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_sig
+#define rcu_defer_set_batch		rcu_defer_set_batch_sig
 #define rcu_defer_exit			rcu_defer_exit_sig
 
 #define rcu_flavor			rcu_flavor_sig
@@ -158,11 +169,20 @@
 #define _rcu_read_lock			_rcu_read_lock_mb
 #define rcu_read_unlock			rcu_read_unlock_mb
 #define _rcu_read_unlock		_rcu_read_unlock_mb
+#define _rcu_read_ongoing		_rcu_read_ongoing_mb
 #define rcu_register_thread		rcu_register_thread_mb
 #define rcu_unregister_thread		rcu_unregister_thread_mb
 #define rcu_init			rcu_init_mb
 #define rcu_exit			rcu_exit_mb
 #define synchronize_rcu			synchronize_rcu_mb
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_mb
+#define get_state_synchronize_rcu	get_state_synchronize_rcu_mb
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_mb
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_mb
+#define rcu_get_gp_stats		rcu_get_gp_stats_mb
+#define rcu_set_stall_detector		rcu_set_stall_detector_mb
+#define rcu_gp_driver_start		rcu_gp_driver_start_mb
+#define rcu_gp_driver_stop		rcu_gp_driver_stop_mb
 #define rcu_reader			rcu_reader_mb
 #define rcu_gp_ctr			rcu_gp_ctr_mb
 #define rcu_gp_futex			rcu_gp_futex_mb
@@ -170,6 +190,9 @@
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_mb
 #define get_call_rcu_thread		get_call_rcu_thread_mb
 #define create_call_rcu_data		create_call_rcu_data_mb
+#define create_call_rcu_data_eventfd	create_call_rcu_data_eventfd_mb
+#define get_call_rcu_eventfd		get_call_rcu_eventfd_mb
+#define call_rcu_run_ready		call_rcu_run_ready_mb
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_mb
 #define get_default_call_rcu_data	get_default_call_rcu_data_mb
 #define get_call_rcu_data		get_call_rcu_data_mb
@@ -178,7 +201,11 @@
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_mb
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_mb
 #define call_rcu			call_rcu_mb
+#define call_rcu_bulk			call_rcu_bulk_mb
+#define free_rcu_head			free_rcu_head_mb
 #define call_rcu_data_free		call_rcu_data_free_mb
+#define rcu_barrier			rcu_barrier_mb
+#define set_call_rcu_data_backlog	set_call_rcu_data_backlog_mb
 #define call_rcu_before_fork		call_rcu_before_fork_mb
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_mb
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_mb
@@ -188,6 +215,8 @@
 #define rcu_defer_unregister_thread	rcu_defer_unregister_thread_mb
 #define rcu_defer_barrier		rcu_defer_barrier_mb
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_mb
+#define rcu_defer_set_queue_limit	rcu_defer_set_queue_limit_mb
+#define rcu_defer_set_batch		rcu_defer_set_batch_mb
 #define rcu_defer_exit			rcu_defer_exit_mb
 
 #define rcu_flavor			rcu_flavor_mb
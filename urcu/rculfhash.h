@@ -100,6 +100,7 @@ void cds_lfht_node_init(struct cds_lfht_node *node)
 enum {
 	CDS_LFHT_AUTO_RESIZE = (1U << 0),
 	CDS_LFHT_ACCOUNTING = (1U << 1),
+	CDS_LFHT_FINGERPRINT = (1U << 2),
 };
 
 struct cds_lfht_mm_type {
@@ -139,7 +140,15 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
  *           CDS_LFHT_AUTO_RESIZE: automatically resize hash table.
  *           CDS_LFHT_ACCOUNTING: count the number of node addition
  *                                and removal in the table
+ *           CDS_LFHT_FINGERPRINT: keep a one byte fingerprint of each
+ *                                node hash in init_size cache-line
+ *                                blocks, letting most lookups of absent
+ *                                keys skip the bucket chain walk. Adds
+ *                                and removals copy a block.
  * @attr: optional resize worker thread attributes. NULL for default.
+ *        Resizes large enough to be split across CPUs start up to one
+ *        resize worker thread per CPU, which exit after one second
+ *        without work.
  *
  * Return NULL on error.
  * Note: the RCU flavor must be already included before the hash table header.
@@ -175,6 +184,7 @@ struct cds_lfht *cds_lfht_new(unsigned long init_size,
  *        need to be informed of the value passed to cds_lfht_new().
  *
  * Return 0 on success, negative error value on error.
+ * On success, the resize worker threads have exited.
  * Threads calling this API need to be registered RCU read-side threads.
  * cds_lfht_destroy should *not* be called from a RCU read-side critical
  * section.
@@ -215,6 +225,27 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		cds_lfht_match_fct match, const void *key,
 		struct cds_lfht_iter *iter);
 
+/*
+ * cds_lfht_lookup_batch - lookup n nodes by key.
+ * @ht: the hash table.
+ * @n: the number of keys.
+ * @hashes: the key hashes.
+ * @match: the key match function.
+ * @keys: the current node keys.
+ * @iters: nodes, if found (output). iters[i].node set to NULL if keys[i]
+ *         is not found.
+ *
+ * Same as n calls to cds_lfht_lookup(), but the chain walks of the
+ * lookups are interleaved, so that their cache misses overlap.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointers.
+ */
+extern
+void cds_lfht_lookup_batch(struct cds_lfht *ht, unsigned long n,
+		const unsigned long *hashes, cds_lfht_match_fct match,
+		const void * const *keys, struct cds_lfht_iter *iters);
+
 /*
  * cds_lfht_next_duplicate - get the next item with same key, after iterator.
  * @ht: the hash table.
@@ -443,6 +474,76 @@ int cds_lfht_is_node_deleted(struct cds_lfht_node *node);
 extern
 void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size);
 
+/*
+ * Nodes with fixed-size keys, for which lookups and adds take no match
+ * function: the specialized functions below compare keys inline, saving
+ * an indirect call and a load through the key pointer per node.
+ * Embed the node as a field, set its key before adding it, and use
+ * caa_container_of() on the node returned by a lookup. They can be
+ * mixed with the generic functions given a match function comparing
+ * the keys the same way, and cds_lfht_del() removes them.
+ */
+struct cds_lfht_key_u128 {
+	uint64_t lo, hi;
+};
+
+struct cds_lfht_node_u32 {
+	struct cds_lfht_node node;
+	uint32_t key;
+};
+
+struct cds_lfht_node_u64 {
+	struct cds_lfht_node node;
+	uint64_t key;
+};
+
+struct cds_lfht_node_u128 {
+	struct cds_lfht_node node;
+	struct cds_lfht_key_u128 key;
+};
+
+/*
+ * cds_lfht_lookup_u32/u64/u128 - same as cds_lfht_lookup(), matching
+ * nodes whose key is equal to @key.
+ */
+extern
+void cds_lfht_lookup_u32(struct cds_lfht *ht, unsigned long hash,
+		uint32_t key, struct cds_lfht_iter *iter);
+extern
+void cds_lfht_lookup_u64(struct cds_lfht *ht, unsigned long hash,
+		uint64_t key, struct cds_lfht_iter *iter);
+extern
+void cds_lfht_lookup_u128(struct cds_lfht *ht, unsigned long hash,
+		struct cds_lfht_key_u128 key, struct cds_lfht_iter *iter);
+
+/*
+ * cds_lfht_add_unique_u32/u64/u128 - same as cds_lfht_add_unique(),
+ * with the key of @node.
+ */
+extern
+struct cds_lfht_node *cds_lfht_add_unique_u32(struct cds_lfht *ht,
+		unsigned long hash, struct cds_lfht_node_u32 *node);
+extern
+struct cds_lfht_node *cds_lfht_add_unique_u64(struct cds_lfht *ht,
+		unsigned long hash, struct cds_lfht_node_u64 *node);
+extern
+struct cds_lfht_node *cds_lfht_add_unique_u128(struct cds_lfht *ht,
+		unsigned long hash, struct cds_lfht_node_u128 *node);
+
+/*
+ * cds_lfht_add_replace_u32/u64/u128 - same as cds_lfht_add_replace(),
+ * with the key of @node.
+ */
+extern
+struct cds_lfht_node *cds_lfht_add_replace_u32(struct cds_lfht *ht,
+		unsigned long hash, struct cds_lfht_node_u32 *node);
+extern
+struct cds_lfht_node *cds_lfht_add_replace_u64(struct cds_lfht *ht,
+		unsigned long hash, struct cds_lfht_node_u64 *node);
+extern
+struct cds_lfht_node *cds_lfht_add_replace_u128(struct cds_lfht *ht,
+		unsigned long hash, struct cds_lfht_node_u128 *node);
+
 /*
  * Note: it is safe to perform element removal (del), replacement, or
  * any hash table update operation during any of the following hash
@@ -0,0 +1,146 @@
+#ifndef _URCU_RCULFOHT_H
+#define _URCU_RCULFOHT_H
+
+/*
+ * urcu/rculfoht.h
+ *
+ * Userspace RCU library - Lock-Free Open-Addressing RCU Hash Table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stdint.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * cds_lfoht maps 64-bit keys to 64-bit values, stored inline in an
+ * array of slots probed linearly. No allocation is done per entry.
+ *
+ * Keys 0 and UINT64_MAX are reserved, as are values above
+ * CDS_LFOHT_VALUE_MAX: the table uses them to mark empty slots,
+ * deleted entries and slots being moved to a new array.
+ *
+ * Deleted entries keep their slot until the next resize, which
+ * allocates a new array sized after the number of entries, copies the
+ * entries to it and publishes it with RCU. Resize is triggered by
+ * additions once three quarters of the slots have been used, and is
+ * performed by the adding thread. Other threads help moving the
+ * entries they need, so no update ever waits for another one.
+ *
+ * Only available on 64-bit architectures.
+ */
+#define CDS_LFOHT_VALUE_MAX	((1ULL << 63) - 3)
+
+struct cds_lfoht;
+
+/*
+ * Caution !
+ * Ensure reader and writer threads are registered as urcu readers.
+ */
+
+/*
+ * _cds_lfoht_new - API used by cds_lfoht_new wrapper. Do not use directly.
+ */
+extern
+struct cds_lfoht *_cds_lfoht_new(unsigned long init_size,
+			const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_lfoht_new - allocate a hash table.
+ * @init_size: number of slots to allocate initially. Must be power of two.
+ *
+ * Return NULL on error.
+ * Note: the RCU flavor must be already included before the hash table header.
+ *
+ * Threads calling cds_lfoht_new are NOT required to be registered RCU
+ * read-side threads. It can be called very early. (e.g. before RCU is
+ * initialized)
+ */
+static inline
+struct cds_lfoht *cds_lfoht_new(unsigned long init_size)
+{
+	return _cds_lfoht_new(init_size, &rcu_flavor);
+}
+
+/*
+ * cds_lfoht_destroy - destroy a hash table.
+ * @ht: the hash table to destroy.
+ *
+ * Return 0 on success.
+ * Should only be called when no more concurrent readers nor writers can
+ * possibly access the table. Arrays replaced by earlier resizes are
+ * freed with call_rcu: invoke rcu_barrier() before unloading the code
+ * calling cds_lfoht_destroy.
+ */
+extern
+int cds_lfoht_destroy(struct cds_lfoht *ht);
+
+/*
+ * cds_lfoht_lookup - lookup a key.
+ * @ht: the hash table.
+ * @key: the key to look up.
+ * @value: (output) the value of the key, if found.
+ *
+ * Return 0 if found, -ENOENT if not found, -EINVAL for a reserved key.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+int cds_lfoht_lookup(struct cds_lfoht *ht, uint64_t key, uint64_t *value);
+
+/*
+ * cds_lfoht_add - add a key, unless already present.
+ * @ht: the hash table.
+ * @key: the key to add.
+ * @value: the value of the key, at most CDS_LFOHT_VALUE_MAX.
+ *
+ * Return 0 on success, -EEXIST if the key is already present, -EINVAL
+ * for a reserved key or value.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function issues a full memory barrier before and after its
+ * atomic commit.
+ */
+extern
+int cds_lfoht_add(struct cds_lfoht *ht, uint64_t key, uint64_t value);
+
+/*
+ * cds_lfoht_del - remove a key.
+ * @ht: the hash table.
+ * @key: the key to remove.
+ *
+ * Return 0 on success, -ENOENT if the key is not present, -EINVAL for a
+ * reserved key.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function issues a full memory barrier before and after its
+ * atomic commit.
+ */
+extern
+int cds_lfoht_del(struct cds_lfoht *ht, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCULFOHT_H */
@@ -135,10 +135,8 @@ struct rcu_reader {
 	/* Data used by both reader and synchronize_rcu() */
 	long ctr;
 	/* Data used for registry */
-	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 	pthread_t tid;
-	int alloc;	/* registry entry allocated */
-};
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
 /*
  * Bulletproof version keeps a pointer to a registry not part of the TLS.
@@ -214,6 +212,16 @@ static inline void _rcu_read_unlock(void)
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
 
+/*
+ * Returns whether within a RCU read-side critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	if (caa_unlikely(!URCU_TLS(rcu_reader)))
+		return 0;
+	return URCU_TLS(rcu_reader)->ctr & RCU_GP_CTR_NEST_MASK;
+}
+
 #ifdef __cplusplus 
 }
 #endif
@@ -41,6 +41,7 @@
 #include <urcu/system.h>
 #include <urcu/uatomic.h>
 #include <urcu/list.h>
+#include <urcu/wfstack.h>
 #include <urcu/futex.h>
 #include <urcu/tls-compat.h>
 
@@ -120,6 +121,25 @@ static inline void rcu_debug_yield_init(void)
  */
 extern unsigned long rcu_gp_ctr;
 
+#ifdef RCU_QSBR_TREE
+/*
+ * Tree-structured quiescent state tracking. Readers are grouped into
+ * leaf nodes of up to RCU_QSBR_TREE_FANOUT threads. Rather than having
+ * synchronize_rcu() poll every reader counter, each reader clears its
+ * own bit in its leaf qsmask when it reports a quiescent state, and the
+ * last reader of a leaf decrements the root count of pending leaves.
+ */
+#define RCU_QSBR_TREE_FANOUT	16
+
+struct rcu_qs_node {
+	pthread_mutex_t lock;
+	unsigned long qsmask;		/* Readers the current G.P. waits for */
+	unsigned long online_mask;	/* Online readers */
+	unsigned long used_mask;	/* Registered readers */
+	unsigned long gp_ctr;		/* rcu_gp_ctr of the current G.P. */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+#endif /* #ifdef RCU_QSBR_TREE */
+
 struct rcu_reader {
 	/* Data used by both reader and synchronize_rcu() */
 	unsigned long ctr;
@@ -127,12 +147,36 @@ struct rcu_reader {
 	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 	int waiting;
 	pthread_t tid;
+	struct cds_wfs_node pending;	/* Registration not merged yet */
+#ifdef RCU_QSBR_TREE
+	struct rcu_qs_node *qs_node;	/* Leaf node, set at registration */
+	unsigned long qs_mask;		/* Our bit within the leaf */
+#endif
 };
 
 extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
 
 extern int32_t rcu_gp_futex;
 
+#ifdef RCU_QSBR_TREE
+extern void rcu_qs_report(void);
+extern void rcu_qs_thread_offline(void);
+extern void rcu_qs_thread_online(void);
+
+/*
+ * Report our quiescent state if the current grace period waits for it.
+ * Called from many concurrent threads.
+ */
+static inline void rcu_qs_report_gp(void)
+{
+	struct rcu_reader *reader = &URCU_TLS(rcu_reader);
+
+	if (caa_unlikely(CMM_LOAD_SHARED(reader->qs_node->qsmask)
+			& reader->qs_mask))
+		rcu_qs_report();
+}
+#endif /* #ifdef RCU_QSBR_TREE */
+
 /*
  * Wake-up waiting synchronize_rcu(). Called from many concurrent threads.
  */
@@ -180,6 +224,15 @@ static inline void _rcu_read_unlock(void)
 {
 }
 
+/*
+ * Returns whether the thread is online, thus within a RCU read-side
+ * critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	return URCU_TLS(rcu_reader).ctr;
+}
+
 /*
  * This is a helper function for _rcu_quiescent_state().
  * The first cmm_smp_mb() ensures memory accesses in the prior read-side
@@ -193,8 +246,13 @@ static inline void _rcu_quiescent_state_update_and_wakeup(unsigned long gp_ctr)
 {
 	cmm_smp_mb();
 	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, gp_ctr);
+#ifdef RCU_QSBR_TREE
+	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read qsmask */
+	rcu_qs_report_gp();
+#else
 	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read futex */
 	wake_up_gp();
+#endif
 	cmm_smp_mb();
 }
 
@@ -214,8 +272,19 @@ static inline void _rcu_quiescent_state(void)
 {
 	unsigned long gp_ctr;
 
-	if ((gp_ctr = CMM_LOAD_SHARED(rcu_gp_ctr)) == URCU_TLS(rcu_reader).ctr)
+	if ((gp_ctr = CMM_LOAD_SHARED(rcu_gp_ctr)) == URCU_TLS(rcu_reader).ctr) {
+#if defined(RCU_QSBR_TREE) && (CAA_BITS_PER_LONG < 64)
+		/*
+		 * The parity counter repeats every other grace period: a
+		 * thread brought online while the previous one was starting
+		 * may already hold the value of the current one, without
+		 * having reported it to its leaf.
+		 */
+		cmm_smp_mb();	/* read-side accesses before report */
+		rcu_qs_report_gp();
+#endif
 		return;
+	}
 	_rcu_quiescent_state_update_and_wakeup(gp_ctr);
 }
 
@@ -231,8 +300,12 @@ static inline void _rcu_thread_offline(void)
 {
 	cmm_smp_mb();
 	CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, 0);
+#ifdef RCU_QSBR_TREE
+	rcu_qs_thread_offline();
+#else
 	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read futex */
 	wake_up_gp();
+#endif
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
 
@@ -247,7 +320,11 @@ static inline void _rcu_thread_offline(void)
 static inline void _rcu_thread_online(void)
 {
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
+#ifdef RCU_QSBR_TREE
+	rcu_qs_thread_online();
+#else
 	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, CMM_LOAD_SHARED(rcu_gp_ctr));
+#endif
 	cmm_smp_mb();
 }
 
@@ -39,6 +39,7 @@
 #include <urcu/system.h>
 #include <urcu/uatomic.h>
 #include <urcu/list.h>
+#include <urcu/wfstack.h>
 #include <urcu/futex.h>
 #include <urcu/tls-compat.h>
 
@@ -51,30 +52,6 @@ extern "C" {
 #define RCU_MEMBARRIER
 #endif
 
-/*
- * RCU_MEMBARRIER is only possibly available on Linux. Fallback to RCU_MB
- * otherwise.
- */
-#if !defined(__linux__) && defined(RCU_MEMBARRIER)
-#undef RCU_MEMBARRIER
-#define RCU_MB
-#endif
-
-#ifdef RCU_MEMBARRIER
-#include <syscall.h>
-
-/* If the headers do not support SYS_membarrier, statically use RCU_MB */
-#ifdef SYS_membarrier
-# define MEMBARRIER_EXPEDITED		(1 << 0)
-# define MEMBARRIER_DELAYED		(1 << 1)
-# define MEMBARRIER_QUERY		(1 << 16)
-# define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
-#else
-# undef RCU_MEMBARRIER
-# define RCU_MB
-#endif
-#endif
-
 /*
  * This code section can only be included in LGPL 2.1 compatible source code.
  * See below for the function call wrappers which can be used in code meant to
@@ -173,6 +150,11 @@ static inline void rcu_debug_yield_init(void)
 #define RCU_MB_GROUP		MB_GROUP_ALL
 
 #ifdef RCU_MEMBARRIER
+/*
+ * Set at library initialization when the kernel provides
+ * MEMBARRIER_CMD_PRIVATE_EXPEDITED. Otherwise, readers fall back on
+ * cmm_smp_mb() at runtime.
+ */
 extern int rcu_has_sys_membarrier;
 
 static inline void smp_mb_slave(int group)
@@ -221,6 +203,7 @@ struct rcu_reader {
 	/* Data used for registry */
 	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 	pthread_t tid;
+	struct cds_wfs_node pending;	/* Registration not merged yet */
 };
 
 extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
@@ -320,6 +303,14 @@ static inline void _rcu_read_unlock(void)
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
 
+/*
+ * Returns whether within a RCU read-side critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	return URCU_TLS(rcu_reader).ctr & RCU_GP_CTR_NEST_MASK;
+}
+
 #ifdef __cplusplus
 }
 #endif